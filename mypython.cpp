@@ -6,6 +6,32 @@
 #include <sstream>
 #include <stdexcept>
 #include <unordered_map>
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+#include <cstdlib>
+#include <charconv>
+#include <cerrno>
+#include <string_view>
+#include <deque>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// GCC and Clang can jump to the address of a label, the VM uses it to dispatch without a switch
+#if defined(__GNUC__) || defined(__clang__)
+#define HAVE_COMPUTED_GOTO 1
+#else
+#define HAVE_COMPUTED_GOTO 0
+#endif
 
 using namespace std;
 
@@ -39,169 +65,374 @@ enum TokenType
     ELSE,                     // 22
     DEF,                      // 23
     CALL_FUNC,                // 24
-    LOCAL,                    // 25
-    RETURN                    // 26
+    RETURN,                   // 25
+    FLUSH,                    // 26
+    ELIF,                     // 27
+    WHILE,                    // 28
+    FOR,                      // 29
+    IN,                       // 30
+    BREAK,                    // 31
+    CONTINUE                  // 32
 };
 
-struct Token
+// the tokens of a line are stored column by column so the parser's lookahead only reads the byte sized kinds
+// the text of a token is an offset and length into the source, numbers are converted once by the lexer
+class TokenBuffer
 {
-    TokenType type;
-    string value;
-    // token will contain a token type and the value
-    Token(TokenType type, const string &value) : type(type), value(value) {}
+private:
+    const char *source;
+    vector<uint8_t> kinds;
+    vector<uint32_t> offsets;
+    vector<uint32_t> lengths;
+    vector<int32_t> values;
+
+public:
+    TokenBuffer() : source(nullptr) {}
+
+    // drop the tokens but keep the capacity, the offsets of the next tokens are relative to source
+    void reset(const char *source)
+    {
+        this->source = source;
+        kinds.clear();
+        offsets.clear();
+        lengths.clear();
+        values.clear();
+    }
+
+    void push(TokenType kind, size_t offset, size_t length, int value = 0)
+    {
+        kinds.push_back((uint8_t)kind);
+        offsets.push_back((uint32_t)offset);
+        lengths.push_back((uint32_t)length);
+        values.push_back(value);
+    }
+
+    size_t size() const
+    {
+        return kinds.size();
+    }
+    bool empty() const
+    {
+        return kinds.empty();
+    }
+    TokenType kind(size_t i) const
+    {
+        return (TokenType)kinds[i];
+    }
+    string_view text(size_t i) const
+    {
+        return string_view(source + offsets[i], lengths[i]);
+    }
+    int value(size_t i) const
+    {
+        return values[i];
+    }
 };
 //////////////////////////////////////////////////////////////////////////////////
-//                                  SYMBOL TABLE
+//                                  INTERNER
 //////////////////////////////////////////////////////////////////////////////////
-// symbol table will store all the globalVars and its values to use later
-class SymbolTable
+// every identifier gets a small integer id the first time it is lexed
+// the parser, the symbol table and the function registry key on the id so a name is hashed only once
+class Interner
 {
 private:
-    unordered_map<string, int> globalVars;
-    unordered_map<string, int> localVars;
-    unordered_map<string, string> func_declaration;
+    unordered_map<string_view, int> ids; // the views point into names
+    deque<string> names;                 // a deque never moves the strings it holds
 
 public:
-    // use to add variable name and its value into the dictionary (global)
-    void addGlobalVar(const string &name, int value)
+    int intern(string_view name)
     {
-        globalVars[name] = value;
+        auto it = ids.find(name);
+        if (it != ids.end())
+        {
+            return it->second;
+        }
+        int id = (int)names.size();
+        names.emplace_back(name);
+        ids.emplace(names.back(), id);
+        return id;
     }
-    void addLocalVar(const string &name, int value)
+
+    const string &name(int id) const
     {
-        localVars[name] = value;
+        return names[id];
     }
-    // will return to value of the coresponding variable name
-    int getGlobalVar(const string &name)
+
+    size_t size() const
     {
-        int count = 0;
-        if (globalVars.find(name) != globalVars.end())
-        {
-            int result = globalVars.at(name);
-            if (func_declaration.find(name) != func_declaration.end())
-            {
-                count++;
-            }
-            if (func_declaration.find(name) != func_declaration.end() && count == 1)
-            {
-                globalVars.erase(name);
-            }
-            return result;
-        }
-        else
-        {
-            cerr << "Error: Variable " << name << " not found in global scope." << endl;
-            exit(1);
-        }
+        return names.size();
     }
-    int getLocalVar(const string &name) const
+};
+
+static Interner interner;
+
+// keywords are found with a perfect hash of the first and last letter and the length
+// the table is built at compile time and the static_assert fails if a new keyword collides
+struct Keyword
+{
+    const char *word = nullptr;
+    size_t length = 0;
+    TokenType kind = IDENTIFIER;
+};
+
+static constexpr size_t KEYWORD_TABLE_SIZE = 32;
+
+static constexpr size_t keywordHash(char first, char last, size_t length)
+{
+    return ((unsigned char)first + (unsigned char)last + length) % KEYWORD_TABLE_SIZE;
+}
+
+struct KeywordTable
+{
+    Keyword entries[KEYWORD_TABLE_SIZE];
+    bool perfect;
+
+    constexpr KeywordTable() : entries(), perfect(true)
     {
-        if (localVars.find(name) != localVars.end())
-        {
-            return localVars.at(name);
-        }
-        else
+        const Keyword keywords[] = {
+            {"if", 2, IF},
+            {"else", 4, ELSE},
+            {"print", 5, PRINT},
+            {"def", 3, DEF},
+            {"return", 6, RETURN},
+            {"flush", 5, FLUSH},
+            {"elif", 4, ELIF},
+            {"while", 5, WHILE},
+            {"for", 3, FOR},
+            {"in", 2, IN},
+            {"break", 5, BREAK},
+            {"continue", 8, CONTINUE}};
+        for (const Keyword &keyword : keywords)
         {
-            cerr << "Error: Variable " << name << " not found in local scope." << endl;
-            exit(1);
+            Keyword &entry = entries[keywordHash(keyword.word[0], keyword.word[keyword.length - 1], keyword.length)];
+            perfect = perfect && entry.word == nullptr;
+            entry = keyword;
         }
     }
+};
+
+static constexpr KeywordTable keywordTable;
+static_assert(keywordTable.perfect, "two keywords share a slot of the keyword hash");
+
+// one probe and one compare, kind is set when word is a keyword
+static inline bool findKeyword(string_view word, TokenType &kind)
+{
+    const Keyword &entry = keywordTable.entries[keywordHash(word.front(), word.back(), word.size())];
+    if (entry.length == word.size() && memcmp(entry.word, word.data(), word.size()) == 0)
+    {
+        kind = entry.kind;
+        return true;
+    }
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  SYMBOL TABLE
+//////////////////////////////////////////////////////////////////////////////////
+// symbol table will store all the globalVars and its values to use later
+// every global name gets a slot when the program is resolved so the evaluators read it with an array load
+// the locals of the running functions live in one contiguous stack of frames
+class SymbolTable
+{
+private:
+    vector<int> slots; // global slot of every interned name, -1 until the name is first used
+    vector<int> names; // interned name of every global slot
+    vector<int> globalVars;
+    vector<char> globalDefined;
+
+    // frames are laid out one after another, frameBase is where the running function's locals start
+    vector<int> frames;
+    size_t frameBase;
+    size_t frameTop;
+    int depth;
+    int maxDepth;
+
+public:
+    SymbolTable(int maxDepth) : frames(64 * 1024), frameBase(0), frameTop(0), depth(0), maxDepth(maxDepth) {}
 
-    void addFuncInit(const string &func_name, const vector<string> &parameters)
+    // return the global slot of the interned name, a new name gets the next free slot
+    int getSlot(int id)
     {
-        string parameter_list;
-        for (const string &param : parameters)
+        if ((size_t)id >= slots.size())
         {
-            parameter_list += param + ",";
+            slots.resize(interner.size(), -1);
         }
-        if (!parameters.empty())
+        if (slots[id] >= 0)
         {
-            parameter_list.pop_back();
+            return slots[id];
         }
-        func_declaration[func_name] = parameter_list;
+        int slot = (int)names.size();
+        slots[id] = slot;
+        names.push_back(id);
+        globalVars.push_back(0);
+        globalDefined.push_back(false);
+        return slot;
     }
-    // get function parameter
-    string getFunc(const string &func_name) const
+
+    // a global slot that no name refers to, used for the counters of loops at the top level
+    int addHiddenGlobal()
     {
-        if (func_declaration.find(func_name) != func_declaration.end())
-        {
-            return func_declaration.at(func_name);
-        }
-        else
+        names.push_back(-1);
+        globalVars.push_back(0);
+        globalDefined.push_back(true);
+        return (int)names.size() - 1;
+    }
+
+    void setGlobal(int slot, int value)
+    {
+        globalVars[slot] = value;
+        globalDefined[slot] = true;
+    }
+    int getGlobal(int slot) const
+    {
+        if (!globalDefined[slot])
         {
-            cerr << "Error: Variable " << func_name << " not found." << endl;
+            cerr << "Error: Variable " << interner.name(names[slot]) << " not found in global scope." << endl;
             exit(1);
         }
+        return globalVars[slot];
+    }
+    void setLocal(int slot, int value)
+    {
+        frames[frameBase + slot] = value;
+    }
+    int getLocal(int slot) const
+    {
+        return frames[frameBase + slot];
     }
 
-    bool isInFuncList(const string &func_name) const
+    // start a frame of frameSize slots, the count argument values are copied into the first ones
+    // and the other locals start at 0, returns the caller's frame base
+    size_t pushFrame(int frameSize, const int *arguments, size_t count)
     {
-        if (func_declaration.find(func_name) != func_declaration.end())
+        if (depth == maxDepth)
         {
-            return true;
+            cerr << "Error: Maximum recursion depth of " << maxDepth << " exceeded." << endl;
+            exit(1);
         }
-        else
+        if (frameTop + frameSize > frames.size())
         {
-            return false;
+            frames.resize(max(frames.size() * 2, frameTop + frameSize));
         }
+        size_t callerBase = frameBase;
+        frameBase = frameTop;
+        frameTop += frameSize;
+        depth++;
+        copy(arguments, arguments + count, frames.begin() + frameBase);
+        fill(frames.begin() + frameBase + count, frames.begin() + frameTop, 0);
+        return callerBase;
     }
-    bool isInGlobalList(const string &func_name) const
+    void popFrame(size_t callerBase)
     {
-        if (globalVars.find(func_name) != globalVars.end())
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
+        frameTop = frameBase;
+        frameBase = callerBase;
+        depth--;
     }
-    bool isInLocalList(const string &func_name) const
+    // number of running functions, 0 while the top level of the program runs
+    int callDepth() const
     {
-        if (localVars.find(func_name) != localVars.end())
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
+        return depth;
+    }
+
+    bool isInGlobalList(int id) const
+    {
+        return (size_t)id < slots.size() && slots[id] >= 0 && globalDefined[slots[id]];
     }
     void printLocalVars() const
     {
         cout << "Local Variables:" << endl;
-        for (const auto &pair : localVars)
+        for (size_t slot = frameBase; slot < frameTop; slot++)
         {
-            cout << pair.first << " : " << pair.second << endl;
+            cout << "slot " << slot - frameBase << " : " << frames[slot] << endl;
         }
     }
     void printGlobalVars() const
     {
         cout << "Global Variables:" << endl;
-        for (const auto &pair : globalVars)
+        for (size_t slot = 0; slot < names.size(); slot++)
         {
-            cout << pair.first << " : " << pair.second << endl;
+            if (globalDefined[slot] && names[slot] >= 0)
+            {
+                cout << interner.name(names[slot]) << " : " << globalVars[slot] << endl;
+            }
         }
     }
-    void printFuncInit() const
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  LEXER
+//////////////////////////////////////////////////////////////////////////////////
+// every byte of the source belongs to one class, the lexer switches on it instead of testing ctype functions
+enum CharClass : uint8_t
+{
+    CHAR_INVALID,
+    CHAR_SPACE,
+    CHAR_ALPHA,
+    CHAR_DIGIT,
+    CHAR_QUOTE,
+    CHAR_COMMENT,
+    CHAR_SYMBOL,  // one character operators and punctuation
+    CHAR_COMPARE, // = < > which become a two character operator when '=' follows
+};
+
+struct CharTable
+{
+    uint8_t classes[256];
+    uint8_t kinds[256];     // token kind of a CHAR_SYMBOL or of a CHAR_COMPARE on its own
+    uint8_t longKinds[256]; // token kind of a CHAR_COMPARE followed by '='
+
+    constexpr CharTable() : classes(), kinds(), longKinds()
     {
-        cout << "Function Declarations:" << endl;
-        for (const auto &pair : func_declaration)
+        for (int c = 'a'; c <= 'z'; c++)
+        {
+            classes[c] = CHAR_ALPHA;
+            classes[c - 'a' + 'A'] = CHAR_ALPHA;
+        }
+        for (int c = '0'; c <= '9'; c++)
+        {
+            classes[c] = CHAR_DIGIT;
+        }
+        const char spaces[] = " \t\n\v\f\r";
+        for (int i = 0; spaces[i] != '\0'; i++)
+        {
+            classes[(unsigned char)spaces[i]] = CHAR_SPACE;
+        }
+        classes['"'] = CHAR_QUOTE;
+        classes['#'] = CHAR_COMMENT;
+        const char symbols[] = "+-*/(),:";
+        const TokenType symbolKinds[] = {PLUS, MINUS, MULTIPLY, DIVIDE, LPAREN, RPAREN, COMMA, COLON};
+        for (int i = 0; symbols[i] != '\0'; i++)
+        {
+            classes[(unsigned char)symbols[i]] = CHAR_SYMBOL;
+            kinds[(unsigned char)symbols[i]] = symbolKinds[i];
+        }
+        const char compares[] = "=<>";
+        const TokenType shortKinds[] = {SINGLE_EQUAL, LESS_THAN, GREATER_THAN};
+        const TokenType orEqualKinds[] = {DOUBLE_EQUAL, LESS_THAN_OR_EQUAL_TO, GREATER_THAN_OR_EQUAL_TO};
+        for (int i = 0; compares[i] != '\0'; i++)
         {
-            cout << "Function: " << pair.first << "(" << pair.second << ")" << endl;
+            classes[(unsigned char)compares[i]] = CHAR_COMPARE;
+            kinds[(unsigned char)compares[i]] = shortKinds[i];
+            longKinds[(unsigned char)compares[i]] = orEqualKinds[i];
         }
     }
 };
 
-//////////////////////////////////////////////////////////////////////////////////
-//                                  LEXER
-//////////////////////////////////////////////////////////////////////////////////
+static constexpr CharTable charTable;
+
+static inline CharClass charClass(char c)
+{
+    return (CharClass)charTable.classes[(unsigned char)c];
+}
+
+// turns one line into tokens in a single pass, the stack use does not depend on the length of the line
 class Lexer
 {
 private:
-    string input;
+    const char *source; // the tokens record their offsets from here
+    string_view input;
     size_t position;
-    vector<Token> tokens;
+    TokenBuffer tokens;
     char currentChar()
     {
         if (position < input.length())
@@ -216,306 +447,349 @@ private:
 
     void skipWhitespace()
     {
-        while (isspace(currentChar()))
+        while (charClass(currentChar()) == CHAR_SPACE)
             advance();
     }
 
-    string readIdentifier()
+    // add the token that spans from start to the current position of the line
+    void addToken(TokenType kind, size_t start, int value = 0)
+    {
+        tokens.push(kind, input.data() - source + start, position - start, value);
+    }
+
+    // the readers return views of the input so a token never copies its text
+    string_view readIdentifier()
     {
-        string result;
-        while (isalnum(currentChar()))
+        size_t start = position;
+        CharClass c = charClass(currentChar());
+        while (c == CHAR_ALPHA || c == CHAR_DIGIT)
         {
-            result += currentChar();
             advance();
+            c = charClass(currentChar());
         }
-        return result;
+        return input.substr(start, position - start);
     }
 
-    string readNumber()
+    int readNumber()
     {
-        string result;
-        while (isdigit(currentChar()))
+        size_t start = position;
+        int result = 0;
+        while (charClass(currentChar()) == CHAR_DIGIT)
         {
-            result += currentChar();
+            int digit = currentChar() - '0';
+            if (result > (INT32_MAX - digit) / 10)
+            {
+                // the message shows the whole literal and nothing after it
+                while (charClass(currentChar()) == CHAR_DIGIT)
+                {
+                    advance();
+                }
+                cerr << "Error: Number too large: " << input.substr(start, position - start) << endl;
+                exit(1);
+            }
+            result = result * 10 + digit;
             advance();
         }
         return result;
     }
-    string makeString()
+    void makeString()
     {
-        string result;
         // Skip the opening double quote
         advance();
-
-        while (currentChar() != '"' && currentChar() != '\0')
-        {
-            result += currentChar();
-            advance();
-        }
+        size_t end = input.find('"', position);
         // Check if the string is terminated properly
-        if (currentChar() == '\0')
+        if (end == string_view::npos)
         {
             cerr << "Error: Unterminated string literal." << endl;
             exit(1);
         }
+        // the token is the text between the quotes
+        size_t start = position;
+        position = end;
+        addToken(STRING, start);
         // Skip the closing double quote
         advance();
-
-        return result;
     }
-    Token makeEquals()
+
+    // a keyword, or a name whose token value is its interned id
+    void makeWord(size_t start)
     {
-        string result = "=";
-        advance();
-        // Check if the next character is an equal sign
-        if (currentChar() == '=')
-        {
-            result += '=';
-            advance();
-            return Token(DOUBLE_EQUAL, result); // Return double equal if the next character is also an equal sign
-        }
-        else
+        string_view identifier = readIdentifier();
+        TokenType kind;
+        if (findKeyword(identifier, kind))
         {
-            return Token(SINGLE_EQUAL, result); // Return single equal otherwise
+            addToken(kind, start);
         }
-    }
-
-    Token makeGreaterThan()
-    {
-        string result = ">";
-        advance();
-        if (currentChar() == '=')
+        // the whole program is lexed before any def runs, so a call is recognised by its '('
+        else if (currentChar() == '(')
         {
-            result += '=';
-            advance();
-            return Token(GREATER_THAN_OR_EQUAL_TO, result);
+            addToken(CALL_FUNC, start, interner.intern(identifier));
         }
         else
         {
-            return Token(GREATER_THAN, result);
+            addToken(IDENTIFIER, start, interner.intern(identifier));
         }
     }
 
-    Token makeLessThan()
+public:
+    // every line passed to reset must be a view into source
+    Lexer(string_view source) : source(source.data()), position(0)
     {
-        string result = "<";
-        advance();
-        if (currentChar() == '=')
-        {
-            result += '=';
-            advance();
-            return Token(LESS_THAN_OR_EQUAL_TO, result);
-        }
-        else
-        {
-            return Token(LESS_THAN, result);
-        }
     }
 
-public:
-    Lexer(string input) : input(input), position(0)
+    // start over on a new line, the token buffer keeps its capacity so lexing a program reuses it
+    void reset(string_view line)
     {
+        input = line;
+        position = 0;
+        tokens.reset(source);
     }
 
-    const vector<Token> &getTokens() const
+    const TokenBuffer &getTokens() const
     {
         return tokens;
     }
     // create tokens
-    void tokenize(SymbolTable &SymbolTable)
+    void tokenize()
     {
-        while (currentChar() != '\0')
+        size_t length = input.length();
+        while (position < length)
         {
-            // meaning it start with a space belong to either if or else
-            if (isspace(currentChar()))
+            size_t start = position;
+            char c = input[position];
+            switch (charClass(c))
             {
-                while (isspace(currentChar()))
-                {
-                    advance();
-                }
-                // tokenize the part after the spaces
-                tokenize(SymbolTable);
-            }
-            else if (isalpha(currentChar())) // Check if it's an identifier or keyword
+            case CHAR_SPACE:
+                advance();
+                break;
+            case CHAR_ALPHA:
+                makeWord(start);
+                break;
+            case CHAR_DIGIT:
             {
-                string identifier = readIdentifier();
-                if (identifier == "if")
-                {
-                    tokens.push_back(Token(IF, "if"));
-                    advance();
-                    tokenize(SymbolTable);
-                }
-                else if (identifier == "else")
-                {
-                    tokens.push_back(Token(ELSE, "else"));
-                    advance();
-                    tokens.push_back(Token(COLON, ":"));
-                }
-                else if (identifier == "print")
-                {
-                    tokens.push_back(Token(PRINT, "print"));
-
-                    // Check for '(' after 'print'
-                    if (currentChar() != '(')
-                    {
-                        cerr << "Error: Expected '(' after 'print'" << endl;
-                        exit(1);
-                    }
-                    tokens.push_back(Token(LPAREN, "(")); // Push left parenthesis token
-                    advance();                            // Move past '('
-
-                    // Parse and tokenize print arguments
-                    while (currentChar() != ')')
-                    {
-                        // Skip whitespace between arguments
-                        skipWhitespace();
-
-                        // Parse and tokenize the argument
-                        if (currentChar() == '"')
-                        {
-                            tokens.push_back(Token(STRING, makeString()));
-                        }
-                        else
-                        {
-                            tokens.push_back(Token(IDENTIFIER, readIdentifier()));
-                        }
-
-                        // Skip whitespace between arguments
-                        skipWhitespace();
-
-                        // Check for ',' to parse next argument
-                        if (currentChar() == ',')
-                            advance();
-                        else if (currentChar() != ')' && currentChar() != '\0')
-                        {
-                            cerr << "Error: Expected ',' or ')' after argument" << endl;
-                            exit(1);
-                        }
-                        else if (currentChar() == ')')
-                        {
-                            advance(); // Move past ')'
-                            break;     // Exit the loop when encountering the end of the argument list
-                        }
-                    }
-                    tokens.push_back(Token(RPAREN, ")")); // Push right parenthesis token
-                }
-                else if (identifier == "def")
-                {
-                    tokens.push_back(Token(DEF, "def"));
-                }
-                else if (SymbolTable.isInFuncList(identifier) && !SymbolTable.isInGlobalList(identifier))
-                {
-                    tokens.push_back(Token(CALL_FUNC, identifier));
-                }
-                else if (SymbolTable.isInGlobalList(identifier) && SymbolTable.isInFuncList(identifier))
-                {
-                    tokens.push_back(Token(IDENTIFIER, identifier));
-                }
-                else if (identifier == "return")
-                {
-                    tokens.push_back(Token(RETURN, "return"));
-                }
-                else if (identifier == "local")
+                int value = readNumber();
+                addToken(NUMBER, start, value);
+                break;
+            }
+            case CHAR_QUOTE:
+                makeString();
+                break;
+            case CHAR_COMMENT:
+                // the comment runs to the end of the line
+                position = length;
+                break;
+            case CHAR_SYMBOL:
+                advance();
+                addToken((TokenType)charTable.kinds[(unsigned char)c], start);
+                break;
+            case CHAR_COMPARE:
+                // ==, <= and >= are the only two character operators
+                if (position + 1 < length && input[position + 1] == '=')
                 {
-                    tokens.push_back(Token(LOCAL, identifier));
+                    position += 2;
+                    addToken((TokenType)charTable.longKinds[(unsigned char)c], start);
                 }
                 else
                 {
-                    tokens.push_back(Token(IDENTIFIER, identifier));
-                }
-            }
-            else if (isdigit(currentChar()))
-            {
-                tokens.push_back(Token(NUMBER, readNumber()));
-            }
-            else if (currentChar() == '#')
-            {
-                // Skip over comment until end of line
-                while (currentChar() != '\n' && currentChar() != '\0')
-                    advance();
-                continue;
-            }
-            else
-            {
-                switch (currentChar())
-                {
-                case '+':
-                    tokens.push_back(Token(PLUS, "+"));
-                    advance();
-                    break;
-                case '-':
-                    tokens.push_back(Token(MINUS, "-"));
-                    advance();
-                    break;
-                case '*':
-                    tokens.push_back(Token(MULTIPLY, "*"));
-                    advance();
-                    break;
-                case '/':
-                    tokens.push_back(Token(DIVIDE, "/"));
-                    advance();
-                    break;
-                case '(':
-                    tokens.push_back(Token(LPAREN, "("));
-                    advance();
-                    break;
-                case ')':
-                    tokens.push_back(Token(RPAREN, ")"));
-                    advance();
-                    break;
-                case '=':
-                    tokens.push_back(makeEquals());
-                    break;
-                case ',':
-                    tokens.push_back(Token(COMMA, ","));
-                    advance();
-                    break;
-                case ':':
-                    tokens.push_back(Token(COLON, ":"));
                     advance();
-                    break;
-                case '#':
-                    tokens.push_back(Token(HASHTAG, "#"));
-                    advance();
-                    break;
-                case '>':
-                    tokens.push_back(makeGreaterThan());
-                    break;
-                case '<':
-                    tokens.push_back(makeLessThan());
-                    break;
-                case '"':
-                    tokens.push_back(Token(STRING, makeString()));
-                    advance();
-                    break;
-                default:
-                    cout << "Error: Invalid character encountered: " << currentChar() << endl;
-                    exit(1);
+                    addToken((TokenType)charTable.kinds[(unsigned char)c], start);
                 }
+                break;
+            default:
+                cerr << "Error: Invalid character encountered: " << c << endl;
+                exit(1);
             }
-            skipWhitespace();
         }
     }
 };
 
 //////////////////////////////////////////////////////////////////////////////////
-//                                  NODE
+//                                  ARENA
 //////////////////////////////////////////////////////////////////////////////////
-class Node
-{
-public:
-    virtual ~Node() {}
-    virtual void print() const = 0;
-};
-// store number as node
-class NumberNode : public Node
+// fixed size array that lives in an arena, used for the child lists of the nodes
+template <typename T>
+class ArenaArray
 {
-public:
-    int value;
+private:
+    T *items;
+    size_t count;
 
-    NumberNode(int value) : value(value) {}
+public:
+    ArenaArray() : items(nullptr), count(0) {}
+    ArenaArray(T *items, size_t count) : items(items), count(count) {}
 
-    void print() const override
+    T *begin() const
+    {
+        return items;
+    }
+    T *end() const
+    {
+        return items + count;
+    }
+    size_t size() const
+    {
+        return count;
+    }
+    bool empty() const
+    {
+        return count == 0;
+    }
+    T &operator[](size_t index) const
+    {
+        return items[index];
+    }
+};
+
+// bump allocator for everything built while compiling one unit (the program or a function body)
+// objects are placed one after another in large blocks and all of them are released together
+class Arena
+{
+private:
+    struct Destructor
+    {
+        void (*destroy)(void *);
+        void *object;
+    };
+
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    vector<char *> blocks;
+    char *current;
+    size_t remaining;
+    size_t bytesUsed;
+    size_t bytesReserved;
+    // objects with members that own memory (strings) still need their destructor run on release
+    vector<Destructor> destructors;
+
+    void *allocate(size_t size, size_t align)
+    {
+        size_t padding = (align - (reinterpret_cast<uintptr_t>(current) & (align - 1))) & (align - 1);
+        if (current == nullptr || padding + size > remaining)
+        {
+            size_t blockSize = max(BLOCK_SIZE, size + align);
+            current = static_cast<char *>(::operator new(blockSize));
+            blocks.push_back(current);
+            remaining = blockSize;
+            bytesReserved += blockSize;
+            padding = (align - (reinterpret_cast<uintptr_t>(current) & (align - 1))) & (align - 1);
+        }
+        char *result = current + padding;
+        current += padding + size;
+        remaining -= padding + size;
+        bytesUsed += padding + size;
+        return result;
+    }
+
+public:
+    Arena() : current(nullptr), remaining(0), bytesUsed(0), bytesReserved(0) {}
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+        release();
+    }
+
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!is_trivially_destructible<T>::value)
+        {
+            destructors.push_back(Destructor{[](void *p)
+                                             { static_cast<T *>(p)->~T(); },
+                                             object});
+        }
+        return object;
+    }
+
+    template <typename T>
+    ArenaArray<T> makeArray(const vector<T> &items)
+    {
+        static_assert(is_trivially_copyable<T>::value, "arena arrays hold plain values only");
+        if (items.empty())
+        {
+            return ArenaArray<T>();
+        }
+        T *storage = static_cast<T *>(allocate(sizeof(T) * items.size(), alignof(T)));
+        memcpy(storage, items.data(), sizeof(T) * items.size());
+        return ArenaArray<T>(storage, items.size());
+    }
+
+    // free every object of the unit in one go
+    void release()
+    {
+        for (size_t i = destructors.size(); i-- > 0;)
+        {
+            destructors[i].destroy(destructors[i].object);
+        }
+        destructors.clear();
+        for (char *block : blocks)
+        {
+            ::operator delete(block);
+        }
+        blocks.clear();
+        current = nullptr;
+        remaining = 0;
+        bytesUsed = 0;
+        bytesReserved = 0;
+    }
+
+    size_t used() const
+    {
+        return bytesUsed;
+    }
+    size_t reserved() const
+    {
+        return bytesReserved;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  NODE
+//////////////////////////////////////////////////////////////////////////////////
+enum NodeKind
+{
+    NODE_NUMBER,
+    NODE_BINOP,
+    NODE_IDENTIFIER,
+    NODE_ASSIGNMENT,
+    NODE_STRING,
+    NODE_PRINT,
+    NODE_FUNC_INIT,
+    NODE_FUNC_CALL,
+    NODE_RETURN,
+    NODE_BLOCK,
+    NODE_IF,
+    NODE_FUNC_DEF,
+    NODE_FLUSH,
+    NODE_WHILE,
+    NODE_FOR_RANGE,
+    NODE_BREAK,
+    NODE_CONTINUE
+};
+
+// every node carries its kind so the evaluators can switch on it instead of trying casts
+// nodes are owned by the Arena of their compilation unit, nothing deletes a node through a Node pointer
+// so there is no virtual destructor: a node without owning members is trivially destructible
+// and the arena does not have to record a destructor for it, the arena runs the others by their own type
+class Node
+{
+public:
+    const NodeKind kind;
+
+    Node(NodeKind kind) : kind(kind) {}
+    virtual void print() const = 0;
+};
+// store number as node
+class NumberNode : public Node
+{
+public:
+    int value;
+
+    NumberNode(int value) : Node(NODE_NUMBER), value(value) {}
+
+    void print() const override
     {
         cout << value;
     }
@@ -529,13 +803,7 @@ public:
     Node *rightNode;
 
     BinOpNode(TokenType op, Node *leftNode, Node *rightNode)
-        : op(op), leftNode(leftNode), rightNode(rightNode) {}
-
-    ~BinOpNode()
-    {
-        delete leftNode;
-        delete rightNode;
-    }
+        : Node(NODE_BINOP), op(op), leftNode(leftNode), rightNode(rightNode) {}
 
     void print() const override
     {
@@ -582,87 +850,21 @@ public:
 class IdentifierNode : public Node
 {
 public:
-    string name;
-
-    IdentifierNode(const string &name) : name(name)
-    {
-        if (!isValidName(name))
-        {
-            throw std::invalid_argument("Invalid variable name: " + name);
-        }
-    }
-
-    string getName() const
-    {
-        return name;
-    }
-
-    void print() const override
-    {
-        cout << name;
-    }
-
-private:
-    // check if variable name match with the language grammar
-    bool isValidName(const string &name) const
-    {
-        if (name.empty() || !isalpha(name[0]))
-        {
-            return false; // Must start with a letter
-        }
-
-        for (char c : name.substr(1))
-        {
-            if (!isalnum(c) && c)
-            {
-                return false; // Only letters, digits, and underscores are allowed after the first character
-            }
-        }
-
-        return true;
-    }
-};
-class LocalIdentifierNode : public Node
-{
-public:
-    string name;
+    int id; // interned name, the lexer only hands out ids for valid names
+    // global slot or slot in the function's frame, set by the Resolver
+    int slot;
+    bool local;
 
-    LocalIdentifierNode(const string &name) : name(name)
-    {
-        if (!isValidName(name))
-        {
-            throw std::invalid_argument("Invalid variable name: " + name);
-        }
-    }
+    IdentifierNode(int id) : Node(NODE_IDENTIFIER), id(id), slot(-1), local(false) {}
 
-    string getName() const
+    const string &getName() const
     {
-        return name;
+        return interner.name(id);
     }
 
     void print() const override
     {
-        cout << name;
-    }
-
-private:
-    // check if variable name match with the language grammar
-    bool isValidName(const string &name) const
-    {
-        if (name.empty() || !isalpha(name[0]))
-        {
-            return false; // Must start with a letter
-        }
-
-        for (char c : name.substr(1))
-        {
-            if (!isalnum(c) && c)
-            {
-                return false; // Only letters, digits, and underscores are allowed after the first character
-            }
-        }
-
-        return true;
+        cout << getName();
     }
 };
 // node that will store the variable name and the value
@@ -673,13 +875,7 @@ public:
     Node *expression;
 
     AssignmentNode(IdentifierNode *variable, Node *expression)
-        : variable(variable), expression(expression) {}
-
-    ~AssignmentNode()
-    {
-        delete variable;
-        delete expression;
-    }
+        : Node(NODE_ASSIGNMENT), variable(variable), expression(expression) {}
 
     void print() const override
     {
@@ -688,94 +884,70 @@ public:
         expression->print();
     }
 };
-class assignLocalVar : public Node
-{
-public:
-    LocalIdentifierNode *variable;
-    Node *expression;
-
-    assignLocalVar(LocalIdentifierNode *variable, Node *expression)
-        : variable(variable), expression(expression) {}
-
-    ~assignLocalVar()
-    {
-        delete variable;
-        delete expression;
-    }
 
-    void print() const override
-    {
-        variable->print();
-        cout << " = ";
-        expression->print();
-    }
-};
-class accessLocalNode : public Node
+class StringNode : public Node
 {
 private:
-    string name;
+    string value;
 
 public:
-    accessLocalNode(const string &name) : name(name) {}
+    StringNode(const string &value) : Node(NODE_STRING), value(value) {}
 
     void print() const override
     {
-        cout << name;
+        cout << "\"" << value << "\"";
     }
 
-    string getName() const
+    const string &getValue() const
     {
-        return name;
+        return value;
     }
 };
-// this node is to use for accessing the value of the variable
-class AccessNode : public Node
-{
-private:
-    string name;
 
+// flush(): write out everything print has buffered so far
+class FlushNode : public Node
+{
 public:
-    AccessNode(const string &name) : name(name) {}
+    FlushNode() : Node(NODE_FLUSH) {}
 
     void print() const override
     {
-        cout << name;
-    }
-
-    string getName() const
-    {
-        return name;
+        cout << "flush()";
     }
 };
 
-class StringNode : public Node
+// break and continue apply to the innermost loop, the front end rejects them outside of one
+class BreakNode : public Node
 {
-private:
-    string value;
-
 public:
-    StringNode(const string &value) : value(value) {}
+    BreakNode() : Node(NODE_BREAK) {}
 
     void print() const override
     {
-        cout << "\"" << value << "\"";
+        cout << "break";
     }
+};
 
-    const string &getValue() const
+class ContinueNode : public Node
+{
+public:
+    ContinueNode() : Node(NODE_CONTINUE) {}
+
+    void print() const override
     {
-        return value;
+        cout << "continue";
     }
 };
 
 class PrintNode : public Node
 {
 private:
-    vector<Node *> arguments;
+    ArenaArray<Node *> arguments;
 
 public:
-    PrintNode(const vector<Node *> &arguments) : arguments(arguments) {}
+    PrintNode(ArenaArray<Node *> arguments) : Node(NODE_PRINT), arguments(arguments) {}
 
-    const vector<Node *> &getArguments() const
+    const ArenaArray<Node *> &getArguments() const
     {
         return arguments;
     }
@@ -793,49 +965,14 @@ public:
     }
 };
 
-class ifCondition : public Node
-{
-private:
-    vector<Node *> condition;
-
-public:
-    ifCondition(const std::vector<Node *> &condition)
-        : condition(condition) {}
-
-    const vector<Node *> &getCondition() const
-    {
-        return condition;
-    }
-
-    void print() const override
-    {
-        // Print body
-        cout << "Body: ";
-        for (const auto &condition : condition)
-        {
-            condition->print();
-        }
-        cout << ")";
-    }
-};
-
 class func_init : public Node
 {
 public:
     IdentifierNode *func_name;
-    vector<IdentifierNode *> parameters; // Change the type of parameters
-
-    func_init(IdentifierNode *func_name, vector<IdentifierNode *> parameters)
-        : func_name(func_name), parameters(parameters) {}
+    ArenaArray<IdentifierNode *> parameters;
 
-    ~func_init()
-    {
-        delete func_name;
-        for (auto param : parameters)
-        {
-            delete param; // Deallocate memory for each parameter
-        }
-    }
+    func_init(IdentifierNode *func_name, ArenaArray<IdentifierNode *> parameters)
+        : Node(NODE_FUNC_INIT), func_name(func_name), parameters(parameters) {}
 
     void print() const override
     {
@@ -857,446 +994,598 @@ public:
         cout << ")" << endl;
     }
 
-    vector<IdentifierNode *> get_parameters() const
+    const ArenaArray<IdentifierNode *> &get_parameters() const
     {
         return parameters;
     }
 };
 
+struct FunctionBody;
+
+// call of a function by name, the arguments are expressions evaluated in the caller
+// a call is an expression, it evaluates to the value the body returns
 class func_call : public Node
 {
 private:
-    string func_name;
-    vector<string> parameters;
+    int funcId;
+    ArenaArray<Node *> arguments;
 
 public:
-    func_call(const string &func_name, const vector<string> &parameters)
-        : func_name(func_name), parameters(parameters) {}
+    // inline cache of the executor: the function this call ran last and the def version it was found in
+    FunctionBody *cachedBody;
+    uint32_t cacheVersion;
+
+    func_call(int funcId, ArenaArray<Node *> arguments)
+        : Node(NODE_FUNC_CALL), funcId(funcId), arguments(arguments), cachedBody(nullptr), cacheVersion(0) {}
 
     void print() const override
     {
-        cout << func_name << " = ";
-        for (const string &param : parameters)
+        cout << get_func_name() << "(";
+        for (size_t i = 0; i < arguments.size(); i++)
         {
-            cout << param << " ";
+            if (i > 0)
+            {
+                cout << ", ";
+            }
+            arguments[i]->print();
         }
+        cout << ")";
     }
 
-    string get_func_name() const
+    int get_func_id() const
+    {
+        return funcId;
+    }
+    const string &get_func_name() const
     {
-        return func_name;
+        return interner.name(funcId);
     }
 
-    vector<string> get_parameters() const
+    const ArenaArray<Node *> &get_arguments() const
     {
-        return parameters;
+        return arguments;
     }
 };
 
+// return leaves the running function, the call evaluates to the value (0 for a bare return)
 class returnNode : public Node
 {
 private:
-    string returnLocalVar;
-    string func_name;
+    Node *value; // null for a bare return
 
 public:
-    returnNode(const string &returnLocalVar, const string &func_name)
-        : returnLocalVar(returnLocalVar), func_name(func_name) {}
+    returnNode(Node *value) : Node(NODE_RETURN), value(value) {}
 
     void print() const override
     {
-        cout << returnLocalVar;
-        cout << " = ";
-        cout << func_name;
+        cout << "return";
+        if (value != nullptr)
+        {
+            cout << " ";
+            value->print();
+        }
     }
 
-    string get_returnLocalVar() const
-    {
-        return returnLocalVar;
-    }
-    string get_func_name() const
+    Node *getValue() const
     {
-        return func_name;
+        return value;
     }
 };
-//////////////////////////////////////////////////////////////////////////////////
-//                                  PARSER
-//////////////////////////////////////////////////////////////////////////////////
-// PARSER
-class Parser
+
+// list of statements that run one after another (the whole program or an indented block)
+class BlockNode : public Node
 {
 private:
-    const vector<Token> &tokens;
-    size_t currentTokenIndex;
+    ArenaArray<Node *> statements;
 
 public:
-    Parser(const vector<Token> &tokens) : tokens(tokens), currentTokenIndex(0) {}
+    BlockNode(ArenaArray<Node *> statements) : Node(NODE_BLOCK), statements(statements) {}
 
-    Node *parse()
+    const ArenaArray<Node *> &getStatements() const
     {
-        return expression();
+        return statements;
     }
 
-private:
-    // expression will contain the term, operation, and another term
-    Node *expression()
+    void print() const override
     {
-        if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == PRINT)
+        cout << "{" << endl;
+        for (const Node *statement : statements)
         {
-            // Parse the print function arguments
-            vector<Node *> arguments;
-            currentTokenIndex++; // Move past the "print" token
+            statement->print();
+            cout << endl;
+        }
+        cout << "}";
+    }
+};
 
-            if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == LPAREN)
-            {
-                currentTokenIndex++; // Move past the "(" token
+// if statement with the block to run when the condition is true and the optional else block
+class IfNode : public Node
+{
+private:
+    Node *condition;
+    BlockNode *thenBlock;
+    BlockNode *elseBlock;
 
-                // Parse and tokenize print arguments
-                while (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type != RPAREN)
-                {
-                    // Parse the argument and add it to the list of arguments
-                    Node *argument = nullptr;
-                    // Check the type of token to determine how to parse it
-                    switch (tokens[currentTokenIndex].type)
-                    {
-                    case STRING:
-                        argument = new StringNode(tokens[currentTokenIndex].value);
-                        break;
-                    case IDENTIFIER:
-                        argument = new IdentifierNode(tokens[currentTokenIndex].value);
-                        break;
-                    // Handle other token types as needed
-                    default:
-                        cerr << "Error: Unexpected token type while parsing print arguments" << endl;
-                        exit(1);
-                    }
-                    arguments.push_back(argument);
+public:
+    IfNode(Node *condition, BlockNode *thenBlock, BlockNode *elseBlock)
+        : Node(NODE_IF), condition(condition), thenBlock(thenBlock), elseBlock(elseBlock) {}
 
-                    // Move to the next token
-                    currentTokenIndex++;
-                }
+    Node *getCondition() const
+    {
+        return condition;
+    }
+    BlockNode *getThenBlock() const
+    {
+        return thenBlock;
+    }
+    BlockNode *getElseBlock() const
+    {
+        return elseBlock;
+    }
 
-                currentTokenIndex++; // Move past the ")" token
-                // Create and return a new PrintNode with the parsed arguments
-                return new PrintNode(arguments);
-            }
-        }
-        else if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == IF)
+    void print() const override
+    {
+        cout << "if ";
+        condition->print();
+        cout << " ";
+        thenBlock->print();
+        if (elseBlock != nullptr)
         {
-            vector<Node *>
-                conditions;
-            currentTokenIndex++; // move past IF token so it will be at the left bracket
-
-            if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == LEFT_BRACKET)
-            {
-                currentTokenIndex++; // move past the left bracket
-                while (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type != COLON)
-                {
-                    Node *condition = expression();
-                    conditions.push_back(condition);
-                    currentTokenIndex++;
-                    if (tokens[currentTokenIndex].type == RIGHT_BRACKET)
-                    {
-                        break;
-                    }
-                }
-                // currentTokenIndex++; // Move past the "}" token
-                return new ifCondition(conditions);
-            }
+            cout << " else ";
+            elseBlock->print();
         }
-        else if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == DEF)
-        {
-            // Move past 'def'
-            currentTokenIndex++; // identifier
-            string func_name = tokens[currentTokenIndex].value;
-            string parameter;
-            currentTokenIndex++; // '('
+    }
+};
 
-            // Create a vector to store the parameters
-            vector<IdentifierNode *> parameters;
+// while loop, the condition is tested before every run of the body
+class WhileNode : public Node
+{
+private:
+    Node *condition;
+    BlockNode *body;
 
-            if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == LPAREN)
-            {
-                currentTokenIndex++; // Move past the left parenthesis
+public:
+    WhileNode(Node *condition, BlockNode *body) : Node(NODE_WHILE), condition(condition), body(body) {}
 
-                while (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type != COLON)
-                {
-                    // Parse each parameter
-                    parameter = tokens[currentTokenIndex].value;
-                    parameters.push_back(new IdentifierNode(parameter));
-                    currentTokenIndex++;
+    Node *getCondition() const
+    {
+        return condition;
+    }
+    BlockNode *getBody() const
+    {
+        return body;
+    }
 
-                    // Check for comma separator between parameters
-                    if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == COMMA)
-                    {
-                        currentTokenIndex++; // Move past the comma
-                    }
-                    if (tokens[currentTokenIndex].type == RPAREN)
-                    {
-                        break;
-                    }
-                }
+    void print() const override
+    {
+        cout << "while ";
+        condition->print();
+        cout << " ";
+        body->print();
+    }
+};
 
-                return new func_init(new IdentifierNode(func_name), parameters); // Pass parameters by value
-            }
-        }
+// for variable in range(start, stop, step): start, stop and step are evaluated once before the loop
+// the count is a plain integer kept in hidden slots, the variable gets a copy of it before every run of the body
+// so assigning to the variable inside the body does not change the number of iterations
+// the parser leaves the body empty and the front end sets it once the indented lines are compiled
+class ForRangeNode : public Node
+{
+private:
+    IdentifierNode *variable;
+    Node *start;
+    Node *stop;
+    Node *step; // null when range() is given no step
+    BlockNode *body;
+
+public:
+    // the hidden slots of the counter, the stop and the step, set by the resolver
+    int counterSlot;
+    int stopSlot;
+    int stepSlot;
+    bool hiddenLocal;
+
+    ForRangeNode(IdentifierNode *variable, Node *start, Node *stop, Node *step)
+        : Node(NODE_FOR_RANGE), variable(variable), start(start), stop(stop), step(step), body(nullptr),
+          counterSlot(-1), stopSlot(-1), stepSlot(-1), hiddenLocal(false) {}
+
+    IdentifierNode *getVariable() const
+    {
+        return variable;
+    }
+    Node *getStart() const
+    {
+        return start;
+    }
+    Node *getStop() const
+    {
+        return stop;
+    }
+    Node *getStep() const
+    {
+        return step;
+    }
+    BlockNode *getBody() const
+    {
+        return body;
+    }
+    void setBody(BlockNode *block)
+    {
+        body = block;
+    }
 
-        else if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == CALL_FUNC)
+    void print() const override
+    {
+        cout << "for " << variable->getName() << " in range(";
+        start->print();
+        cout << ", ";
+        stop->print();
+        if (step != nullptr)
         {
-            string func_name = tokens[currentTokenIndex].value;
-            currentTokenIndex++; // Move past the function name
-            vector<string> parameters;
+            cout << ", ";
+            step->print();
+        }
+        cout << ") ";
+        body->print();
+    }
+};
 
-            if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == LPAREN)
-            {
-                currentTokenIndex++; // Move past the left parenthesis
+// function definition: the declaration plus the view of the body source that runs on every call
+class FuncDefNode : public Node
+{
+private:
+    func_init *declaration;
+    string_view body;
 
-                // Parse and tokenize the function arguments
-                while (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type != RPAREN)
-                {
-                    string argument = tokens[currentTokenIndex].value;
-                    parameters.push_back(argument);
-                    currentTokenIndex++;
+public:
+    FuncDefNode(func_init *declaration, string_view body)
+        : Node(NODE_FUNC_DEF), declaration(declaration), body(body) {}
 
-                    // Check for comma separator between arguments
-                    if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == COMMA)
-                    {
-                        currentTokenIndex++; // Move past the comma
-                    }
-                }
+    func_init *getDeclaration() const
+    {
+        return declaration;
+    }
+    string_view getBody() const
+    {
+        return body;
+    }
 
-                // Move past the right parenthesis
-                if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == RPAREN)
-                {
-                    currentTokenIndex++;
-                }
+    void print() const override
+    {
+        declaration->print();
+        cout << body << endl;
+    }
+};
 
-                return new func_call(func_name, parameters);
-            }
-        }
+//////////////////////////////////////////////////////////////////////////////////
+//                                  PARSER
+//////////////////////////////////////////////////////////////////////////////////
+// binding power of the binary operators: comparisons bind loosest, then + and -, then * and /
+// any other token has level 0 and ends the expression
+struct PrecedenceTable
+{
+    uint8_t levels[256];
+
+    constexpr PrecedenceTable() : levels()
+    {
+        levels[DOUBLE_EQUAL] = 1;
+        levels[LESS_THAN] = 1;
+        levels[LESS_THAN_OR_EQUAL_TO] = 1;
+        levels[GREATER_THAN] = 1;
+        levels[GREATER_THAN_OR_EQUAL_TO] = 1;
+        levels[PLUS] = 2;
+        levels[MINUS] = 2;
+        levels[MULTIPLY] = 3;
+        levels[DIVIDE] = 3;
+    }
+};
+
+static constexpr PrecedenceTable precedenceTable;
+
+// PARSER
+class Parser
+{
+private:
+    const TokenBuffer &tokens;
+    size_t currentTokenIndex;
+    Arena &arena;
+    int functionId; // function whose body is parsed, -1 for the program where return is an error
+
+public:
+    // the nodes are allocated in the arena of the unit being compiled
+    Parser(const TokenBuffer &tokens, Arena &arena, int functionId)
+        : tokens(tokens), currentTokenIndex(0), arena(arena), functionId(functionId) {}
 
-        else if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == RETURN)
+    // a statement takes the whole line, a token left over is an error
+    Node *parse()
+    {
+        Node *ast = statement();
+        if (ast != nullptr && currentTokenIndex < tokens.size())
         {
-            currentTokenIndex++;                                     // move pass return token
-            string returnLocalVar = tokens[currentTokenIndex].value; // get the return var
-            currentTokenIndex++;
-            string func_name = tokens[currentTokenIndex].value; // get the func_name
-            return new returnNode(returnLocalVar, func_name);
+            cerr << "Error: Unexpected token '" << tokens.text(currentTokenIndex) << "'" << endl;
+            exit(1);
         }
-        else if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == LOCAL)
+        return ast;
+    }
+
+private:
+    // the first token decides what kind of statement the line is
+    Node *statement()
+    {
+        if (tokens.empty())
         {
-            currentTokenIndex++;
             return nullptr;
         }
-        // handle global variables
-        else if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == IDENTIFIER && tokens[tokens.size() - 1].type != LOCAL)
+        switch (tokens.kind(0))
         {
-            // looking for equal sign so that it know that it should be a variable
-            if (currentTokenIndex + 1 < tokens.size() && tokens[currentTokenIndex + 1].type == SINGLE_EQUAL)
+        case PRINT:
+            currentTokenIndex++; // move past print
+            if (!nextIs(LPAREN))
             {
-                string identifier = tokens[currentTokenIndex].value;
-                currentTokenIndex += 2;
-                Node *value = expression();
-                // value->print();
-                // cout << "\n";
-                // assign that indentifier with its value
-                return new AssignmentNode(new IdentifierNode(identifier), value);
+                cerr << "Error: Expected '(' after 'print'" << endl;
+                exit(1);
             }
-            // access node from variable that already defined and create an expression
-            else
+            // every argument is a string or an expression
+            return arena.make<PrintNode>(argumentList(true));
+        case IF:
+        case ELIF:
+        case WHILE:
+        {
+            // the condition is the expression between the keyword and the colon
+            string_view keyword = tokens.text(currentTokenIndex++);
+            Node *condition = expression();
+            expectColon(keyword);
+            return condition;
+        }
+        case DEF:
+        {
+            currentTokenIndex++; // move past def
+            if (!nextIs(CALL_FUNC) && !nextIs(IDENTIFIER))
+            {
+                cerr << "Error: Expected a function name after 'def'" << endl;
+                exit(1);
+            }
+            int func_name = tokens.value(currentTokenIndex++);
+            if (!nextIs(LPAREN))
+            {
+                cerr << "Error: Expected '(' after def " << interner.name(func_name) << endl;
+                exit(1);
+            }
+            currentTokenIndex++;
+
+            // the parameters become the first locals of the frame in this order
+            vector<IdentifierNode *> parameters;
+            while (nextIs(IDENTIFIER))
             {
-                // Parse the identifier
-                string identifier = tokens[currentTokenIndex++].value;
-                // Check if there is a binary operation after the identifier
-                if (currentTokenIndex < tokens.size() &&
-                    (tokens[currentTokenIndex].type == PLUS || tokens[currentTokenIndex].type == MINUS ||
-                     tokens[currentTokenIndex].type == MULTIPLY || tokens[currentTokenIndex].type == DIVIDE || tokens[currentTokenIndex].type == LESS_THAN ||
-                     tokens[currentTokenIndex].type == GREATER_THAN || tokens[currentTokenIndex].type == LESS_THAN_OR_EQUAL_TO ||
-                     tokens[currentTokenIndex].type == GREATER_THAN_OR_EQUAL_TO || tokens[currentTokenIndex].type == DOUBLE_EQUAL))
+                int param = tokens.value(currentTokenIndex++);
+                for (const IdentifierNode *previous : parameters)
                 {
-                    // Save the operation type
-                    TokenType opType = tokens[currentTokenIndex++].type;
-                    // Parse the right-hand side of the expression
-                    Node *right = term();
-                    // Create a BinOpNode with the identifier as the left operand, operation, and right-hand side
-                    Node *result = new BinOpNode(opType, new AccessNode(identifier), right);
-                    // Parse any subsequent operations and their operands
-                    while (currentTokenIndex < tokens.size() &&
-                           (tokens[currentTokenIndex].type == PLUS || tokens[currentTokenIndex].type == MINUS || tokens[currentTokenIndex].type == LESS_THAN ||
-                            tokens[currentTokenIndex].type == GREATER_THAN || tokens[currentTokenIndex].type == LESS_THAN_OR_EQUAL_TO ||
-                            tokens[currentTokenIndex].type == GREATER_THAN_OR_EQUAL_TO || tokens[currentTokenIndex].type == DOUBLE_EQUAL))
+                    if (previous->id == param)
                     {
-                        // Save the operation type
-                        opType = tokens[currentTokenIndex++].type;
-
-                        // Parse the next term
-                        right = term();
-                        // Update the result with the new operation and right-hand side
-                        result = new BinOpNode(opType, result, right);
+                        cerr << "Error: Duplicate parameter " << interner.name(param) << " in def " << interner.name(func_name) << endl;
+                        exit(1);
                     }
-                    return result;
                 }
-                // If there is no binary operation, treat it as a simple variable access
-                else
+                parameters.push_back(arena.make<IdentifierNode>(param));
+                if (!nextIs(COMMA))
                 {
-                    return new AccessNode(identifier);
+                    break;
                 }
+                currentTokenIndex++;
+            }
+            if (!nextIs(RPAREN))
+            {
+                cerr << "Error: Expected ')' after the parameters of def " << interner.name(func_name) << endl;
+                exit(1);
             }
+            currentTokenIndex++;
+            expectColon("def");
+            return arena.make<func_init>(arena.make<IdentifierNode>(func_name), arena.makeArray(parameters));
         }
-        // handle local variables
-        else if (currentTokenIndex < tokens.size() && tokens[currentTokenIndex].type == IDENTIFIER && tokens[tokens.size() - 1].type == LOCAL)
-        {
+        case FOR:
+            return forRange();
+        case BREAK:
+            currentTokenIndex++;
+            return arena.make<BreakNode>();
+        case CONTINUE:
+            currentTokenIndex++;
+            return arena.make<ContinueNode>();
+        case FLUSH:
+            currentTokenIndex++; // move past flush
+            if (currentTokenIndex + 1 >= tokens.size() || tokens.kind(currentTokenIndex) != LPAREN || tokens.kind(currentTokenIndex + 1) != RPAREN)
+            {
+                cerr << "Error: flush takes no arguments, expected 'flush()'" << endl;
+                exit(1);
+            }
+            currentTokenIndex += 2;
+            return arena.make<FlushNode>();
+        case RETURN:
+            currentTokenIndex++; // move pass return token
+            if (functionId < 0)
+            {
+                cerr << "Error: return outside of a function" << endl;
+                exit(1);
+            }
+            if (currentTokenIndex == tokens.size())
+            {
+                return arena.make<returnNode>(nullptr);
+            }
+            return arena.make<returnNode>(expression());
+        case IDENTIFIER:
             // looking for equal sign so that it know that it should be a variable
-            if (currentTokenIndex + 1 < tokens.size() && tokens[currentTokenIndex + 1].type == SINGLE_EQUAL)
+            if (tokens.size() > 1 && tokens.kind(1) == SINGLE_EQUAL)
             {
-                string identifier = tokens[currentTokenIndex].value;
-                currentTokenIndex += 2;
-                Node *value = expression();
-                // assign that indentifier with its value
-                return new assignLocalVar(new LocalIdentifierNode(identifier), value);
+                int identifier = tokens.value(0);
+                currentTokenIndex = 2;
+                return arena.make<AssignmentNode>(arena.make<IdentifierNode>(identifier), expression());
             }
-            // access node from variable that already defined and create an expression
-            else
+            return expression();
+        default:
+            return expression();
+        }
+    }
+
+    // precedence climbing: an operand, then every operator that binds at least as tight as minLevel
+    // the right operand only takes operators that bind tighter, so equal levels group to the left
+    Node *expression(int minLevel = 1)
+    {
+        Node *left = factor();
+        while (currentTokenIndex < tokens.size())
+        {
+            TokenType op = tokens.kind(currentTokenIndex);
+            int level = precedenceTable.levels[op];
+            if (level < minLevel)
             {
-                // Parse the identifier
-                string identifier = tokens[currentTokenIndex++].value;
+                break;
+            }
+            currentTokenIndex++;
+            Node *right = expression(level + 1);
+            left = arena.make<BinOpNode>(op, left, right);
+        }
+        return left;
+    }
 
-                // Check if there is a binary operation after the identifier
-                if (currentTokenIndex < tokens.size() &&
-                    (tokens[currentTokenIndex].type == PLUS || tokens[currentTokenIndex].type == MINUS ||
-                     tokens[currentTokenIndex].type == MULTIPLY || tokens[currentTokenIndex].type == DIVIDE || tokens[currentTokenIndex].type == LESS_THAN ||
-                     tokens[currentTokenIndex].type == GREATER_THAN || tokens[currentTokenIndex].type == LESS_THAN_OR_EQUAL_TO ||
-                     tokens[currentTokenIndex].type == GREATER_THAN_OR_EQUAL_TO || tokens[currentTokenIndex].type == DOUBLE_EQUAL))
-                {
-                    // Save the operation type
-                    TokenType opType = tokens[currentTokenIndex++].type;
-                    // Parse the right-hand side of the expression
-                    Node *right = term();
-                    // Create a BinOpNode with the identifier as the left operand, operation, and right-hand side
-                    Node *result = new BinOpNode(opType, new accessLocalNode(identifier), right);
-                    // Parse any subsequent operations and their operands
-                    while (currentTokenIndex < tokens.size() &&
-                           (tokens[currentTokenIndex].type == PLUS || tokens[currentTokenIndex].type == MINUS || tokens[currentTokenIndex].type == LESS_THAN ||
-                            tokens[currentTokenIndex].type == GREATER_THAN || tokens[currentTokenIndex].type == LESS_THAN_OR_EQUAL_TO ||
-                            tokens[currentTokenIndex].type == GREATER_THAN_OR_EQUAL_TO || tokens[currentTokenIndex].type == DOUBLE_EQUAL))
-                    {
-                        // Save the operation type
-                        opType = tokens[currentTokenIndex++].type;
+    bool nextIs(TokenType kind) const
+    {
+        return currentTokenIndex < tokens.size() && tokens.kind(currentTokenIndex) == kind;
+    }
 
-                        // Parse the next term
-                        right = term();
+    // the colon that ends the header of a statement with a block
+    void expectColon(string_view keyword)
+    {
+        if (!nextIs(COLON))
+        {
+            cerr << "Error: Expected ':' after " << keyword << endl;
+            exit(1);
+        }
+        currentTokenIndex++;
+    }
 
-                        // Update the result with the new operation and right-hand side
-                        result = new BinOpNode(opType, result, right);
-                    }
-                    return result;
-                }
-                // If there is no binary operation, treat it as a simple variable access
-                else
-                {
-                    return new accessLocalNode(identifier);
-                }
+    // a parenthesized list of expressions separated by commas, the current token is the left parenthesis
+    // the arguments of print may also be strings, the only place a string is a value
+    ArenaArray<Node *> argumentList(bool strings = false)
+    {
+        currentTokenIndex++; // move past the left parenthesis
+        vector<Node *> arguments;
+        if (!nextIs(RPAREN))
+        {
+            arguments.push_back(argument(strings));
+            while (nextIs(COMMA))
+            {
+                currentTokenIndex++;
+                arguments.push_back(argument(strings));
             }
         }
-        Node *result = term();
-        // this will parse if the token is not an identifier (i.e. 3 + 2 + 3) group it in a expression ((3+2)+3)
-        while (currentTokenIndex < tokens.size() &&
-               (tokens[currentTokenIndex].type == PLUS || tokens[currentTokenIndex].type == MINUS || tokens[currentTokenIndex].type == LESS_THAN ||
-                tokens[currentTokenIndex].type == GREATER_THAN || tokens[currentTokenIndex].type == LESS_THAN_OR_EQUAL_TO ||
-                tokens[currentTokenIndex].type == GREATER_THAN_OR_EQUAL_TO || tokens[currentTokenIndex].type == DOUBLE_EQUAL))
+        if (!nextIs(RPAREN))
         {
-            TokenType opType = tokens[currentTokenIndex++].type;
-            Node *right = term();
-            result = new BinOpNode(opType, result, right);
+            cerr << "Error: Expected ',' or ')' after argument" << endl;
+            exit(1);
         }
-        return result;
+        currentTokenIndex++;
+        return arena.makeArray(arguments);
     }
 
-    // a term can contain a factor or a factor follow by an operation sign and another factor
-    Node *term()
+    // a string on its own up to the next ',' or ')', or an expression
+    Node *argument(bool strings)
     {
-        Node *result = factor();
-        while (currentTokenIndex < tokens.size() &&
-               (tokens[currentTokenIndex].type == MULTIPLY || tokens[currentTokenIndex].type == DIVIDE))
+        if (strings && nextIs(STRING) && currentTokenIndex + 1 < tokens.size() &&
+            (tokens.kind(currentTokenIndex + 1) == COMMA || tokens.kind(currentTokenIndex + 1) == RPAREN))
         {
-            TokenType opType = tokens[currentTokenIndex++].type;
-            Node *right = factor();
-            result = new BinOpNode(opType, result, right);
+            return arena.make<StringNode>(string(tokens.text(currentTokenIndex++)));
         }
-
-        return result;
+        return expression();
     }
 
-    Node *factor()
+    // for name in range(stop), range(start, stop) or range(start, stop, step)
+    // the body is left empty, the front end compiles the indented lines into it
+    Node *forRange()
     {
-        Token currentToken = tokens[currentTokenIndex++];
-        if (currentToken.type == NUMBER)
+        currentTokenIndex++; // move past for
+        if (!nextIs(IDENTIFIER))
         {
-            return new NumberNode(stoi(currentToken.value));
+            cerr << "Error: Expected a variable name after 'for'" << endl;
+            exit(1);
         }
-        else if (currentToken.type == MINUS)
+        IdentifierNode *variable = arena.make<IdentifierNode>(tokens.value(currentTokenIndex++));
+        if (!nextIs(IN))
         {
-            currentToken = tokens[currentTokenIndex++];
-            int negativeVal = stoi(currentToken.value) * -1;
-            return new NumberNode(negativeVal);
+            cerr << "Error: Expected 'in' after the for variable" << endl;
+            exit(1);
         }
-        else if (currentToken.type == IDENTIFIER && tokens[tokens.size() - 1].type != LOCAL)
+        currentTokenIndex++;
+        if (!nextIs(CALL_FUNC) || tokens.text(currentTokenIndex) != "range")
         {
-            return new IdentifierNode(currentToken.value);
+            cerr << "Error: for loops only iterate over range(...)" << endl;
+            exit(1);
         }
-        else if (currentToken.type == IDENTIFIER && tokens[tokens.size() - 1].type == LOCAL)
+        currentTokenIndex++; // move past range
+
+        ArenaArray<Node *> bounds = argumentList();
+        if (bounds.empty() || bounds.size() > 3)
         {
-            return new LocalIdentifierNode(currentToken.value);
+            cerr << "Error: range takes one to three arguments" << endl;
+            exit(1);
         }
-        else if (currentToken.type == STRING)
+        expectColon("for");
+
+        if (bounds.size() == 1)
         {
-            return new StringNode(currentToken.value);
+            return arena.make<ForRangeNode>(variable, arena.make<NumberNode>(0), bounds[0], nullptr);
         }
-        else if (currentToken.type == CALL_FUNC)
-        {
-            string func_name = currentToken.value;
-            currentToken = tokens[currentTokenIndex++];
-            vector<string> parameters;
+        return arena.make<ForRangeNode>(variable, bounds[0], bounds[1], bounds.size() == 3 ? bounds[2] : nullptr);
+    }
 
-            if (currentToken.type == LPAREN)
+    // a number, a name, a string, a call, a parenthesized expression or a negated factor
+    Node *factor()
+    {
+        if (currentTokenIndex >= tokens.size())
+        {
+            cerr << "Error: Expected an expression at the end of the line" << endl;
+            exit(1);
+        }
+        size_t current = currentTokenIndex++;
+        if (tokens.kind(current) == NUMBER)
+        {
+            return arena.make<NumberNode>(tokens.value(current));
+        }
+        else if (tokens.kind(current) == MINUS)
+        {
+            Node *operand = factor();
+            if (operand->kind == NODE_NUMBER)
             {
-                currentToken = tokens[currentTokenIndex++];
-                // Parse and tokenize the function arguments
-                while (currentToken.type != RPAREN)
-                {
-                    string argument = currentToken.value;
-                    parameters.push_back(argument);
-                    currentToken = tokens[currentTokenIndex++];
-
-                    // Check for comma separator between arguments
-                    if (currentToken.type == COMMA)
-                    {
-                        currentToken = tokens[currentTokenIndex++];
-                    }
-                }
-
-                // Move past the right parenthesis
-                if (currentToken.type == RPAREN)
-                {
-                    currentToken = tokens[currentTokenIndex++];
-                }
-                return new func_call(func_name, parameters);
+                return arena.make<NumberNode>(-static_cast<NumberNode *>(operand)->value);
             }
+            return arena.make<BinOpNode>(MINUS, arena.make<NumberNode>(0), operand);
+        }
+        else if (tokens.kind(current) == IDENTIFIER)
+        {
+            return arena.make<IdentifierNode>(tokens.value(current));
+        }
+        else if (tokens.kind(current) == STRING)
+        {
+            cerr << "Error: A string can only be an argument of print" << endl;
+            exit(1);
         }
-        else if (currentToken.type == LPAREN)
+        else if (tokens.kind(current) == CALL_FUNC)
+        {
+            // the lexer only makes a CALL_FUNC token when a left parenthesis follows
+            return arena.make<func_call>(tokens.value(current), argumentList());
+        }
+        else if (tokens.kind(current) == LPAREN)
         {
             // If it's not a function call, parse the expression within parentheses
             Node *result = expression();
-            if (tokens[currentTokenIndex++].type != RPAREN)
+            if (!nextIs(RPAREN))
             {
                 cerr << "Error: Expected closing parenthesis ')'" << endl;
                 exit(1);
             }
+            currentTokenIndex++;
             return result;
         }
         else
         {
-            cerr << "Error: Invalid token encountered." << currentToken.value << endl;
+            cerr << "Error: Invalid token encountered." << tokens.text(current) << endl;
             exit(1);
         }
         return nullptr;
@@ -1304,952 +1593,6127 @@ private:
 };
 
 //////////////////////////////////////////////////////////////////////////////////
-//                                  INTERPRETER
+//                                  FRONT END
 //////////////////////////////////////////////////////////////////////////////////
-class Interpreter
+// one line of the source with its indentation, blank and comment lines are marked so blocks can skip them
+// the text is a view into the source buffer
+struct SourceLine
+{
+    string_view text;
+    int indent;
+    bool blank;
+};
+
+// lexes and parses the whole source once and builds the program level block
+// every node of the unit is allocated in the given arena
+class FrontEnd
 {
+private:
+    Arena &arena;
+    string_view source;
+    Lexer lexer;
+    int functionId;           // interned name of the function being compiled, -1 for the program
+    int loopDepth;            // loops around the line being compiled, break and continue need one
+
+    FrontEnd(Arena &arena, string_view source, int functionId)
+        : arena(arena), source(source), lexer(source), functionId(functionId), loopDepth(0) {}
+
 public:
-    static int evaluate(Node *root, SymbolTable &symbolTable)
+    static BlockNode *compile(string_view source, Arena &arena)
     {
-        if (root == nullptr)
-        {
-            cerr << "Error: Empty AST" << endl;
-            exit(1);
-        }
+        return compileUnit(source, -1, arena);
+    }
 
-        return evaluateNode(root, symbolTable);
+    // a function body is compiled from its view of the source on the first call
+    static BlockNode *compileFunction(string_view body, int functionId, Arena &arena)
+    {
+        return compileUnit(body, functionId, arena);
     }
 
 private:
-    // this will evaluate the parse list
-    static int evaluateNode(Node *node, SymbolTable &symbolTable)
+    static BlockNode *compileUnit(string_view source, int functionId, Arena &arena)
+    {
+        FrontEnd frontEnd(arena, source, functionId);
+        vector<SourceLine> lines = splitLines(source);
+        size_t index = 0;
+        return frontEnd.compileBlock(lines, index, -1);
+    }
+
+    static vector<SourceLine> splitLines(string_view source)
+    {
+        vector<SourceLine> lines;
+        size_t lineStart = 0;
+        while (lineStart < source.size())
+        {
+            size_t lineEnd = source.find('\n', lineStart);
+            if (lineEnd == string_view::npos)
+            {
+                lineEnd = source.size();
+            }
+            string_view line = source.substr(lineStart, lineEnd - lineStart);
+            size_t start = line.find_first_not_of(" \t");
+            bool blank = start == string_view::npos || line[start] == '#';
+            lines.push_back(SourceLine{line, blank ? 0 : (int)start, blank});
+            lineStart = lineEnd + 1;
+        }
+        return lines;
+    }
+
+    Node *parseLine(const TokenBuffer &tokens, string_view line)
     {
-        if (NumberNode *numberNode = dynamic_cast<NumberNode *>(node))
+        Parser parser(tokens, arena, functionId);
+        Node *ast = parser.parse();
+        if (ast == nullptr)
         {
-            return numberNode->value;
+            cerr << "Error parsing line: " << line << endl;
+            exit(1);
         }
-        else if (IdentifierNode *identifierNode = dynamic_cast<IdentifierNode *>(node))
+        return ast;
+    }
+
+    // true when the line starts with the keyword word
+    static bool startsWithWord(const SourceLine &line, string_view word)
+    {
+        string_view text = line.text.substr(line.indent);
+        return text.compare(0, word.size(), word) == 0 && (text.size() == word.size() || !isalnum(text[word.size()]));
+    }
+
+    static size_t nextCodeLine(const vector<SourceLine> &lines, size_t index)
+    {
+        while (index < lines.size() && lines[index].blank)
         {
-            return symbolTable.getGlobalVar(identifierNode->getName());
+            index++;
         }
-        else if (LocalIdentifierNode *localIdenNode = dynamic_cast<LocalIdentifierNode *>(node))
+        return index;
+    }
+
+    // compile every line indented deeper than parentIndent into one block
+    BlockNode *compileBlock(const vector<SourceLine> &lines, size_t &index, int parentIndent)
+    {
+        vector<Node *> statements;
+        while ((index = nextCodeLine(lines, index)) < lines.size() && lines[index].indent > parentIndent)
         {
-            if (symbolTable.isInLocalList(localIdenNode->getName()))
+            const SourceLine &line = lines[index++];
+            lexer.reset(line.text);
+            lexer.tokenize();
+            const TokenBuffer &tokens = lexer.getTokens();
+            if (tokens.empty())
             {
-                return symbolTable.getLocalVar(localIdenNode->getName());
+                continue;
             }
-            else if (!symbolTable.isInLocalList(localIdenNode->getName()) && symbolTable.isInGlobalList(localIdenNode->getName()))
+
+            if (tokens.kind(0) == IF)
             {
-                return symbolTable.getGlobalVar(localIdenNode->getName());
+                statements.push_back(compileIf(tokens, lines, index, line));
             }
-        }
-        else if (BinOpNode *binOpNode = dynamic_cast<BinOpNode *>(node))
-        {
-            int leftValue = evaluateNode(binOpNode->leftNode, symbolTable);
-            int rightValue = evaluateNode(binOpNode->rightNode, symbolTable);
-
-            switch (binOpNode->op)
+            else if (tokens.kind(0) == ELSE || tokens.kind(0) == ELIF)
             {
-            case PLUS:
-                return leftValue + rightValue;
-            case MINUS:
-                return leftValue - rightValue;
-            case MULTIPLY:
-                return leftValue * rightValue;
-            case DIVIDE:
-                if (rightValue == 0)
+                cerr << "Error: " << tokens.text(0) << " without a matching if: " << line.text << endl;
+                exit(1);
+            }
+            else if (tokens.kind(0) == WHILE || tokens.kind(0) == FOR)
+            {
+                statements.push_back(compileLoop(tokens, lines, index, line));
+            }
+            else if (tokens.kind(0) == BREAK || tokens.kind(0) == CONTINUE)
+            {
+                if (loopDepth == 0)
                 {
-                    cerr << "Error: Division by zero" << endl;
+                    cerr << "Error: " << tokens.text(0) << " outside of a loop: " << line.text << endl;
                     exit(1);
                 }
-                return leftValue / rightValue;
-            // return 1 for true and 0 for false
-            case DOUBLE_EQUAL:
-                return leftValue == rightValue;
-            case LESS_THAN:
-                return leftValue < rightValue;
-            case LESS_THAN_OR_EQUAL_TO:
-                return leftValue <= rightValue;
-            case GREATER_THAN:
-                return leftValue > rightValue;
-            case GREATER_THAN_OR_EQUAL_TO:
-                return leftValue >= rightValue;
-            default:
-                cerr << "Error: Unknown operator" << endl;
-                exit(1);
+                statements.push_back(parseLine(tokens, line.text));
+            }
+            else if (tokens.kind(0) == DEF)
+            {
+                Node *ast = parseLine(tokens, line.text);
+                if (ast->kind != NODE_FUNC_INIT)
+                {
+                    cerr << "Error parsing function definition: " << line.text << endl;
+                    exit(1);
+                }
+                string_view body = functionBody(lines, index, line.indent);
+                statements.push_back(arena.make<FuncDefNode>(static_cast<func_init *>(ast), body));
+            }
+            else
+            {
+                statements.push_back(parseLine(tokens, line.text));
             }
         }
-        else if (AccessNode *accessNode = dynamic_cast<AccessNode *>(node))
-        {
-            return symbolTable.getGlobalVar(accessNode->getName());
-        }
-        else if (accessLocalNode *accessLocal = dynamic_cast<accessLocalNode *>(node))
+        return arena.make<BlockNode>(arena.makeArray(statements));
+    }
+
+    // an if or elif line with its block, an elif becomes an if nested as the whole else block
+    // the branches are blocks, so the evaluators skip a branch that is not taken in one step
+    IfNode *compileIf(const TokenBuffer &tokens, const vector<SourceLine> &lines, size_t &index, const SourceLine &line)
+    {
+        Node *condition = parseLine(tokens, line.text);
+        BlockNode *thenBlock = compileBlock(lines, index, line.indent);
+        BlockNode *elseBlock = nullptr;
+        index = nextCodeLine(lines, index);
+        if (index < lines.size() && lines[index].indent == line.indent)
         {
-            if (symbolTable.isInLocalList(accessLocal->getName()))
+            const SourceLine &next = lines[index];
+            if (startsWithWord(next, "elif"))
             {
-                return symbolTable.getLocalVar(accessLocal->getName());
+                index++;
+                lexer.reset(next.text);
+                lexer.tokenize();
+                Node *elifNode = compileIf(lexer.getTokens(), lines, index, next);
+                elseBlock = arena.make<BlockNode>(arena.makeArray(vector<Node *>{elifNode}));
             }
-            else if (!symbolTable.isInLocalList(accessLocal->getName()) && symbolTable.isInGlobalList(accessLocal->getName()))
+            else if (startsWithWord(next, "else"))
             {
-                return symbolTable.getGlobalVar(accessLocal->getName());
+                index++;
+                lexer.reset(next.text);
+                lexer.tokenize();
+                if (lexer.getTokens().size() != 2 || lexer.getTokens().kind(1) != COLON)
+                {
+                    cerr << "Error: Expected ':' after else" << endl;
+                    exit(1);
+                }
+                elseBlock = compileBlock(lines, index, line.indent);
             }
         }
-        else if (AssignmentNode *assignmentNode = dynamic_cast<AssignmentNode *>(node))
+        return arena.make<IfNode>(condition, thenBlock, elseBlock);
+    }
+
+    // a while or for line with its body, the body is compiled once however often the loop runs it
+    Node *compileLoop(const TokenBuffer &tokens, const vector<SourceLine> &lines, size_t &index, const SourceLine &line)
+    {
+        Node *header = parseLine(tokens, line.text);
+        loopDepth++;
+        BlockNode *body = compileBlock(lines, index, line.indent);
+        loopDepth--;
+        if (header->kind == NODE_FOR_RANGE)
         {
-            int assignedValue = evaluateNode(assignmentNode->expression, symbolTable);
-            symbolTable.addGlobalVar(assignmentNode->variable->getName(), assignedValue);
-            return assignedValue;
-        }
-        else if (assignLocalVar *assignmentNode = dynamic_cast<assignLocalVar *>(node))
-        {
-            int assignedValue = evaluateNode(assignmentNode->expression, symbolTable);
-            // cout << "local: " << assignedValue << endl;
-            symbolTable.addLocalVar(assignmentNode->variable->getName(), assignedValue);
-            return assignedValue;
-        }
-        // this node is for the print function
-        else if (PrintNode *printNode = dynamic_cast<PrintNode *>(node))
-        {
-            const vector<Node *> &arguments = printNode->getArguments();
-            for (size_t i = 0; i < arguments.size(); ++i)
-            {
-                Node *argument = arguments[i];
-                if (StringNode *stringArg = dynamic_cast<StringNode *>(argument))
-                {
-                    cout << stringArg->getValue();
-                }
-                else if (NumberNode *numberArg = dynamic_cast<NumberNode *>(argument))
-                {
-                    cout << numberArg->value;
-                }
-                else
-                {
-                    // Evaluate and print other types of nodes
-                    int value = evaluateNode(argument, symbolTable);
-                    cout << value;
-                }
-
-                // Print a space after each argument except for the last one
-                if (i < arguments.size() - 1)
-                    cout << " ";
-            }
-            cout << endl; // Print newline after printing all arguments
-            return 0;
-        }
-        else if (ifCondition *conditionNode = dynamic_cast<ifCondition *>(node))
-        {
-            const vector<Node *> &conditions = conditionNode->getCondition();
-            bool result = true; // Default result is true
-
-            for (Node *condition : conditions)
-            {
-                int conditionValue = evaluateNode(condition, symbolTable);
-                if (conditionValue == 0) // If any condition evaluates to false, set result to false
-                {
-                    result = false;
-                    break;
-                }
-            }
-
-            return result ? 1 : 0; // Convert bool result to integer (1 for true, 0 for false)
-        }
-        else if (func_init *func_node = dynamic_cast<func_init *>(node))
-        {
-            // Get the function name and its parameters
-            string func_name = func_node->func_name->getName();
-            vector<string> param_names; // Vector to store parameter names
-
-            for (const IdentifierNode *param_ptr : func_node->get_parameters())
-            {
-                const IdentifierNode &param = *param_ptr;
-                param_names.push_back(param.getName());
-            }
-            symbolTable.addFuncInit(func_name, param_names);
-            for (const IdentifierNode *param_ptr : func_node->get_parameters())
-            {
-                const IdentifierNode &param = *param_ptr;
-                int param_init = 0;
-                symbolTable.addLocalVar(param.getName(), param_init);
-            }
-            return 0;
+            static_cast<ForRangeNode *>(header)->setBody(body);
+            return header;
         }
+        return arena.make<WhileNode>(header, body);
+    }
 
-        else if (func_call *func_node = dynamic_cast<func_call *>(node))
+    // the body of a def is the run of lines indented deeper than it, kept as one view of the source
+    static string_view functionBody(const vector<SourceLine> &lines, size_t &index, int defIndent)
+    {
+        const char *begin = nullptr;
+        const char *end = nullptr;
+        while ((index = nextCodeLine(lines, index)) < lines.size() && lines[index].indent > defIndent)
         {
-            int funcname_init = 0;
-            int index = 0;
-            vector<string> parameters = func_node->get_parameters();
-
-            for (const auto &param : parameters)
+            const SourceLine &line = lines[index++];
+            if (begin == nullptr)
             {
-                int reAssignVal;
-                // int reAssignVal = symbolTable.getGlobalVar(param);
-                if (symbolTable.isInGlobalList(param))
-                {
-                    reAssignVal = symbolTable.getGlobalVar(param);
-                }
-                else if (symbolTable.isInLocalList(param))
-                {
-                    reAssignVal = symbolTable.getLocalVar(param);
-                }
-                string func_name = func_node->get_func_name();
-                string param_init = symbolTable.getFunc(func_name);
-                if (param_init.find(",") != std::string::npos)
-                {
-                    string paramChar(1, param_init[index]);
-                    symbolTable.addLocalVar(paramChar, reAssignVal);
-                    index++;
-                    if (param_init[index] == ',')
-                    {
-                        index++;
-                    }
-                }
-                else
-                {
-                    symbolTable.addLocalVar(param_init, reAssignVal);
-                }
+                begin = line.text.data();
             }
-            symbolTable.addGlobalVar(func_node->get_func_name(), funcname_init);
-            return 0;
-        }
-        else if (returnNode *return_node = dynamic_cast<returnNode *>(node))
-        {
-            int reAssignVal = symbolTable.getLocalVar(return_node->get_returnLocalVar());
-            symbolTable.addGlobalVar(return_node->get_func_name(), reAssignVal);
-            return 0;
-        }
-        else
-        {
-            cerr << "Error: Unexpected node" << endl;
-            exit(1);
+            end = line.text.data() + line.text.size();
         }
-        return 0;
+        return begin == nullptr ? string_view() : string_view(begin, end - begin);
     }
 };
 
 //////////////////////////////////////////////////////////////////////////////////
-//                                  READ FILE
+//                                  RESOLVER
 //////////////////////////////////////////////////////////////////////////////////
-string readFile(const string &fileName)
+// gives every variable node of a compiled unit its slot so nothing hashes names at run time
+// inside a function the parameters and every assigned name are locals in the frame, any other name is global
+class Resolver
 {
-    ifstream file(fileName);
-    if (!file)
+private:
+    SymbolTable &symbolTable;
+    unordered_map<int, int> *locals; // interned name to frame slot, null for the top level
+    int hiddenSlots;                 // frame slots after the named locals taken by loop counters
+
+    Resolver(SymbolTable &symbolTable, unordered_map<int, int> *locals)
+        : symbolTable(symbolTable), locals(locals), hiddenSlots(0) {}
+
+public:
+    static void resolveProgram(BlockNode *program, SymbolTable &symbolTable)
     {
-        cerr << "Unable to open file: " << fileName << endl;
-        exit(1);
+        Resolver resolver(symbolTable, nullptr);
+        resolver.resolve(program);
+    }
+
+    // resolve a function body, the parameters take the first slots of the frame
+    // returns the number of slots the frame needs
+    static int resolveFunction(BlockNode *body, const vector<int> &parameters, SymbolTable &symbolTable)
+    {
+        unordered_map<int, int> locals;
+        for (int param : parameters)
+        {
+            addLocal(param, locals);
+        }
+        collectLocals(body, locals);
+        Resolver resolver(symbolTable, &locals);
+        resolver.resolve(body);
+        return (int)locals.size() + resolver.hiddenSlots;
     }
 
-    string content;
-    string line;
-    bool copied = false; // Flag to track if a line has been copied
+private:
+    static void addLocal(int name, unordered_map<int, int> &locals)
+    {
+        locals.emplace(name, (int)locals.size());
+    }
 
-    while (getline(file, line))
+    static void collectLocals(Node *node, unordered_map<int, int> &locals)
     {
-        // Check if the line satisfies the condition
-        if (!line.empty() &&
-            line.find("=") != string::npos &&
-            line.find("(") != string::npos &&
-            line.find(")") != string::npos &&
-            line.find("print") == string::npos)
+        switch (node->kind)
         {
-            // If the condition is met and a line has not been copied yet, make a copy of it and add it below
-            if (!copied)
+        case NODE_ASSIGNMENT:
+            addLocal(static_cast<AssignmentNode *>(node)->variable->id, locals);
+            collectLocals(static_cast<AssignmentNode *>(node)->expression, locals);
+            break;
+        case NODE_BLOCK:
+            for (Node *statement : static_cast<BlockNode *>(node)->getStatements())
             {
-                // Copy the line with content inside parentheses trimmed
-                string copiedLine = line;
-                size_t startPos = copiedLine.find("(");
-                size_t endPos = copiedLine.find(")");
-                copiedLine.erase(startPos, endPos - startPos + 1);
-
-                // Add the trimmed copy below the original line
-                content += line + '\n';
-                content += copiedLine + '\n';
-                copied = false;
+                collectLocals(statement, locals);
             }
-            else
+            break;
+        case NODE_IF:
+            collectLocals(static_cast<IfNode *>(node)->getThenBlock(), locals);
+            if (static_cast<IfNode *>(node)->getElseBlock() != nullptr)
             {
-                // Add the original line
-                content += line + '\n';
+                collectLocals(static_cast<IfNode *>(node)->getElseBlock(), locals);
             }
+            break;
+        case NODE_WHILE:
+            collectLocals(static_cast<WhileNode *>(node)->getBody(), locals);
+            break;
+        case NODE_FOR_RANGE:
+            addLocal(static_cast<ForRangeNode *>(node)->getVariable()->id, locals);
+            collectLocals(static_cast<ForRangeNode *>(node)->getBody(), locals);
+            break;
+        default:
+            break;
         }
-        else
+    }
+
+    void resolveVariable(int name, int &slot, bool &local)
+    {
+        if (locals != nullptr)
         {
-            // If the line doesn't meet the condition, add it as it is
-            content += line + '\n';
+            auto it = locals->find(name);
+            if (it != locals->end())
+            {
+                slot = it->second;
+                local = true;
+                return;
+            }
         }
+        slot = symbolTable.getSlot(name);
+        local = false;
     }
 
-    file.close();
-    return content;
-}
-//////////////////////////////////////////////////////////////////////////////////
-//                                  MAIN
-//////////////////////////////////////////////////////////////////////////////////
-int main(int argc, char *argv[])
-{
+    // a slot no variable can name, in the frame inside a function and a global at the top level
+    int hiddenSlot()
+    {
+        if (locals != nullptr)
+        {
+            return (int)locals->size() + hiddenSlots++;
+        }
+        return symbolTable.addHiddenGlobal();
+    }
 
-    // if (argc != 2)
-    // {
-    //     cerr << "Usage: " << argv[0] << " <filename>" << endl;
-    //     return 1;
-    // }
-
-    // // Extract the filename from command-line arguments
-    // string fileName = argv[1];
-    string fileName = "/Users/joel/Desktop/School/2024spring/ProgrammingLanguages/hwwithvariables/4315-HW2/test.py";
-    string input = readFile(fileName);
-
-    // Create a symbol table
-    SymbolTable symbolTable;
-
-    // Initialize the flags to indicate if the next line should be skipped
-    bool skipStatement = false;
-    bool elseCase = false;
-    // innitialize the flags to indicate if the it's first or second level if else statement (2 levels)
-    bool first_lv_if = false;
-    bool first_lv_else = false;
-    bool second_lv_if = false;
-    bool second_lv_else = false;
-    // set flag if the next lines belong to a function
-    bool function_block = false;
-    string func_name;
-    stringstream func_block;
-    // Split the input into lines
-    stringstream ss(input);
-    string line;
-    vector<size_t> subPosition;
-    unordered_map<string, string> funcBlockMap;
-    // cout << ss.str() << endl;
-    while (getline(ss, line))
-    {
-        // Skip empty lines or lines containing only comments
-        if (!line.empty() && line[0] == ' ' && line.find_first_not_of(" \t") != std::string::npos && line.find_first_not_of(" \t") == line.find('#'))
-        {
-            // The line starts with a white space and is a comment
-            continue;
-        }
-        if (function_block)
-        {
-            if (line.empty())
-            {
-                func_block << line << endl;
-                continue;
+    void resolve(Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_NUMBER:
+        case NODE_STRING:
+        case NODE_FLUSH:
+        case NODE_BREAK:
+        case NODE_CONTINUE:
+            break;
+        case NODE_IDENTIFIER:
+        {
+            IdentifierNode *identifierNode = static_cast<IdentifierNode *>(node);
+            resolveVariable(identifierNode->id, identifierNode->slot, identifierNode->local);
+            break;
+        }
+        case NODE_BINOP:
+            resolve(static_cast<BinOpNode *>(node)->leftNode);
+            resolve(static_cast<BinOpNode *>(node)->rightNode);
+            break;
+        case NODE_ASSIGNMENT:
+            resolve(static_cast<AssignmentNode *>(node)->variable);
+            resolve(static_cast<AssignmentNode *>(node)->expression);
+            break;
+        case NODE_PRINT:
+            for (Node *argument : static_cast<PrintNode *>(node)->getArguments())
+            {
+                resolve(argument);
             }
-            else if (!line.empty() && line[0] == ' ' && line.find("return") == std::string::npos && line.find("else") == std::string::npos && line.find("if") == std::string::npos && line.find("=") == std::string::npos)
+            break;
+        case NODE_FUNC_INIT:
+            break;
+        case NODE_FUNC_CALL:
+            for (Node *argument : static_cast<func_call *>(node)->get_arguments())
             {
-                func_block << line << endl;
-                continue;
+                resolve(argument);
             }
-            else if (!line.empty() && line.find("return") != std::string::npos)
+            break;
+        case NODE_RETURN:
+            if (static_cast<returnNode *>(node)->getValue() != nullptr)
             {
-                string trimmed_line = line.substr(subPosition[0]);
-                func_block << trimmed_line << " " << func_name << endl;
-                continue;
+                resolve(static_cast<returnNode *>(node)->getValue());
             }
-            else if (!line.empty() && line[0] == ' ' && line.find("return") == std::string::npos && line.find("else") == std::string::npos)
+            break;
+        case NODE_BLOCK:
+            for (Node *statement : static_cast<BlockNode *>(node)->getStatements())
             {
-                size_t position = line.find_first_not_of(" \t");
-                subPosition.push_back(position);
-                string trimmed_line = line.substr(subPosition[0]);
-                func_block << trimmed_line << " local" << endl;
-                continue;
+                resolve(statement);
             }
-            else if (!line.empty() && line.find("else") != std::string::npos)
+            break;
+        case NODE_IF:
+        {
+            IfNode *ifNode = static_cast<IfNode *>(node);
+            resolve(ifNode->getCondition());
+            resolve(ifNode->getThenBlock());
+            if (ifNode->getElseBlock() != nullptr)
             {
-                string trimmed_line = line.substr(subPosition[0]);
-                func_block << trimmed_line << endl;
-                continue;
+                resolve(ifNode->getElseBlock());
             }
-            else
+            break;
+        }
+        case NODE_FUNC_DEF:
+            resolve(static_cast<FuncDefNode *>(node)->getDeclaration());
+            break;
+        case NODE_WHILE:
+            resolve(static_cast<WhileNode *>(node)->getCondition());
+            resolve(static_cast<WhileNode *>(node)->getBody());
+            break;
+        case NODE_FOR_RANGE:
+        {
+            ForRangeNode *forNode = static_cast<ForRangeNode *>(node);
+            resolve(forNode->getVariable());
+            resolve(forNode->getStart());
+            resolve(forNode->getStop());
+            if (forNode->getStep() != nullptr)
             {
-                string stored_function_block = func_block.str();
-                funcBlockMap[func_name] = stored_function_block;
-                func_block.str("");
-                function_block = false;
+                resolve(forNode->getStep());
             }
-            // cout << func_block.str() << endl;
+            forNode->counterSlot = hiddenSlot();
+            forNode->stopSlot = hiddenSlot();
+            forNode->stepSlot = hiddenSlot();
+            forNode->hiddenLocal = locals != nullptr;
+            resolve(forNode->getBody());
+            break;
         }
-        // skip first level if else statement
-        if (skipStatement == true && (first_lv_if || first_lv_else) && !second_lv_if && !second_lv_else)
+        }
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  OUTPUT
+//////////////////////////////////////////////////////////////////////////////////
+// print() writes into one large buffer that goes to the file descriptor with write(2)
+// line buffered output is written at the end of every line, block buffered output when the buffer fills,
+// at flush() and when the program exits
+// it is also a streambuf so cerr can be tied to it and error messages never overtake buffered output
+class OutputWriter : public streambuf
+{
+private:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+    int fd;
+    vector<char> buffer;
+    size_t used;
+    bool lineBuffered;
+    size_t writeCalls;
+
+    void writeAll(const char *data, size_t length)
+    {
+        while (length > 0)
         {
-            // cout << line << endl;
-            if (!line.empty() && line[0] == ' ')
+            ssize_t written = ::write(fd, data, length);
+            writeCalls++;
+            if (written < 0)
             {
-                continue;
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return; // the reader went away, drop the output
             }
-            else
+            data += written;
+            length -= written;
+        }
+    }
+
+protected:
+    int sync() override
+    {
+        flush();
+        return 0;
+    }
+
+public:
+    OutputWriter(int fd) : fd(fd), buffer(BUFFER_SIZE), used(0), lineBuffered(isatty(fd)), writeCalls(0) {}
+
+    ~OutputWriter()
+    {
+        flush();
+    }
+
+    void setLineBuffered(bool lineBuffered)
+    {
+        this->lineBuffered = lineBuffered;
+    }
+
+    void writeString(string_view text)
+    {
+        if (text.size() > BUFFER_SIZE - used)
+        {
+            flush();
+            if (text.size() >= BUFFER_SIZE)
             {
-                skipStatement = false;
+                writeAll(text.data(), text.size());
+                return;
             }
         }
-        // set first level if flag to true
-        else if (!line.empty() && line[0] == 'i' && line[1] == 'f' && !first_lv_if)
+        memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+    }
+
+    void writeChar(char c)
+    {
+        if (used == BUFFER_SIZE)
         {
-            // cout << line << endl;
-            first_lv_if = true;
-            first_lv_else = false;
-            second_lv_if = false;
-            second_lv_else = false;
+            flush();
         }
-        // set first level else flag to true
-        else if (!line.empty() && line[0] == 'e' && line[1] == 'l' && line[2] == 's' && line[3] == 'e' && !first_lv_else)
+        buffer[used++] = c;
+    }
+
+    void writeInt(int value)
+    {
+        // an int takes at most 11 characters
+        if (BUFFER_SIZE - used < 16)
         {
-            // cout << line << endl;
-            first_lv_else = true;
-            first_lv_if = false;
-            second_lv_if = false;
-            second_lv_else = false;
+            flush();
         }
-        // set second level if flag to true
-        else if (!line.empty() && line[0] == ' ' && line[4] == 'i' && line[5] == 'f')
+        char *end = to_chars(buffer.data() + used, buffer.data() + BUFFER_SIZE, value).ptr;
+        used = end - buffer.data();
+    }
+
+    void endLine()
+    {
+        writeChar('\n');
+        if (lineBuffered)
         {
-            // cout << line << endl;
-            second_lv_if = true;
-            second_lv_else = false;
+            flush();
         }
-        // set second level else flag to true
-        else if (!line.empty() && line[0] == ' ' && line[4] == 'e' && line[5] == 'l' && line[6] == 's' && line[7] == 'e')
+    }
+
+    void flush()
+    {
+        if (used > 0)
         {
-            // cout << line << endl;
-            second_lv_else = true;
-            second_lv_if = false;
+            writeAll(buffer.data(), used);
+            used = 0;
         }
-        // skip second level if
-        if (skipStatement == true && second_lv_if)
+    }
+
+    size_t getWriteCalls() const
+    {
+        return writeCalls;
+    }
+};
+
+static OutputWriter output(STDOUT_FILENO);
+static ostream outputStream(&output); // only used to tie cerr to the writer
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  FLAT AST
+//////////////////////////////////////////////////////////////////////////////////
+// the tree walker runs on a flat copy of the resolved and optimized tree: every node of a unit sits in one
+// vector, links are 32 bit indices and what does not fit in a node goes to side arrays
+// a node's children are stored before it, so an expression is one contiguous run of nodes
+// nothing in it is a pointer, so the whole tree can be written out and read back with memcpy
+// names are interner ids and variables are resolved slots, so a saved tree only means something
+// to the process that built it, with the same interner and symbol table
+static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+// what each kind keeps in the fields of a node
+//   NUMBER                value = the number
+//   IDENTIFIER            value = slot, local = frame slot or global
+//   BINOP                 op = operator token, first = left, second = right
+//   ASSIGNMENT            value = slot, local, first = expression
+//   STRING                value = index in strings
+//   PRINT                 first = argument list
+//   FUNC_CALL             value = interned function name, first = argument list, second = call site
+//   RETURN                first = value, NO_NODE for a bare return
+//   BLOCK                 first = statement list
+//   IF                    first = condition, second = then block, value = else block or NO_NODE
+//   WHILE                 first = condition, second = body
+//   FOR_RANGE             value = index in ranges
+//   FUNC_DEF              value = interned function name, first = parameter list, second = body in strings
+//   FLUSH, BREAK, CONTINUE
+// a list is its length in lists[first] followed by the entries
+struct FlatNode
+{
+    uint8_t kind;
+    uint8_t op;
+    uint8_t local;
+    uint8_t unused;
+    int32_t value;
+    uint32_t first;
+    uint32_t second;
+};
+static_assert(sizeof(FlatNode) == 16, "a flat node should stay 16 bytes");
+
+// the slots a range loop keeps its variable, counter, stop and step in, set by the resolver
+struct RangeSlots
+{
+    int variableSlot;
+    int counterSlot;
+    int stopSlot;
+    int stepSlot;
+    bool variableLocal;
+    bool hiddenLocal;
+};
+
+static RangeSlots rangeSlots(const ForRangeNode *loop)
+{
+    return RangeSlots{loop->getVariable()->slot, loop->counterSlot, loop->stopSlot, loop->stepSlot,
+                      loop->getVariable()->local, loop->hiddenLocal};
+}
+
+struct FlatRange
+{
+    RangeSlots slots;
+    uint32_t start;
+    uint32_t stop;
+    uint32_t step; // NO_NODE when range() is given no step
+    uint32_t body;
+};
+
+struct FlatString
+{
+    uint32_t offset; // into text
+    uint32_t length;
+};
+
+class FlatAst
+{
+public:
+    vector<FlatNode> nodes;
+    vector<uint32_t> lists;
+    vector<FlatRange> ranges;
+    vector<FlatString> strings;
+    vector<char> text;
+    uint32_t root;
+    uint32_t callSites;
+
+    // inline cache of every call site: the function it ran last and the def version it was found in
+    // filled in by the executor, it is not part of the saved tree
+    struct CallCache
+    {
+        FunctionBody *body;
+        uint32_t version;
+    };
+    mutable vector<CallCache> callCaches;
+
+private:
+    vector<uint32_t> scratch; // only used while the tree is built
+
+public:
+
+    FlatAst() : root(NO_NODE), callSites(0) {}
+
+    static FlatAst build(const BlockNode *block)
+    {
+        FlatAst ast;
+        ast.root = ast.add(block);
+        ast.scratch = vector<uint32_t>();
+        ast.callCaches.assign(ast.callSites, CallCache{nullptr, 0});
+        return ast;
+    }
+
+    bool empty() const
+    {
+        return nodes.empty();
+    }
+
+    const uint32_t *listBegin(uint32_t list) const
+    {
+        return lists.data() + list + 1;
+    }
+    const uint32_t *listEnd(uint32_t list) const
+    {
+        return lists.data() + list + 1 + lists[list];
+    }
+
+    string_view getString(int index) const
+    {
+        return string_view(text.data() + strings[index].offset, strings[index].length);
+    }
+
+    size_t bytes() const
+    {
+        return nodes.size() * sizeof(FlatNode) + lists.size() * sizeof(uint32_t) + ranges.size() * sizeof(FlatRange) +
+               strings.size() * sizeof(FlatString) + text.size();
+    }
+
+    // the arrays one after another behind a header that holds their sizes, in the byte order of this machine
+    // the interned names are not written, deserialize expects them in the interner already
+    vector<char> serialize() const
+    {
+        uint32_t header[] = {root, callSites, (uint32_t)nodes.size(), (uint32_t)lists.size(),
+                             (uint32_t)ranges.size(), (uint32_t)strings.size(), (uint32_t)text.size()};
+        vector<char> data(sizeof(header) + bytes());
+        char *out = data.data();
+        out = writeArray(out, header, sizeof(header) / sizeof(header[0]));
+        out = writeArray(out, nodes.data(), nodes.size());
+        out = writeArray(out, lists.data(), lists.size());
+        out = writeArray(out, ranges.data(), ranges.size());
+        out = writeArray(out, strings.data(), strings.size());
+        writeArray(out, text.data(), text.size());
+        return data;
+    }
+
+    static FlatAst deserialize(const vector<char> &data)
+    {
+        uint32_t header[7];
+        if (data.size() < sizeof(header))
         {
-            if (!line.empty() && line[0] == ' ' && !second_lv_else)
-            {
-                // cout << line << endl;
-                continue;
-            }
-            else
-            {
-                skipStatement = false;
-            }
+            cerr << "Error: Truncated flat tree" << endl;
+            exit(1);
         }
-        // skip second level else
-        if (skipStatement == true && second_lv_else)
+        const char *in = readArray(data.data(), header, 7);
+        FlatAst ast;
+        ast.root = header[0];
+        ast.callSites = header[1];
+        ast.nodes.resize(header[2]);
+        ast.lists.resize(header[3]);
+        ast.ranges.resize(header[4]);
+        ast.strings.resize(header[5]);
+        ast.text.resize(header[6]);
+        if (data.size() != sizeof(header) + ast.bytes())
         {
-            // cout << line << endl;
-            if (!line.empty() && line[0] == ' ' && line[4] == ' ' && !second_lv_if)
-            {
-                // cout << line << endl;
-                continue;
-            }
-            else
-            {
-                skipStatement = false;
-            }
+            cerr << "Error: Truncated flat tree" << endl;
+            exit(1);
         }
-        // Tokenize the line
-        Lexer lexer(line);
-        lexer.tokenize(symbolTable);
-        const vector<Token> &tokens = lexer.getTokens();
-        // for (const Token &token : tokens)
-        // {
-        //     cout << "value: " << token.value << " Type: " << token.type << endl;
-        // }
+        in = readArray(in, ast.nodes.data(), ast.nodes.size());
+        in = readArray(in, ast.lists.data(), ast.lists.size());
+        in = readArray(in, ast.ranges.data(), ast.ranges.size());
+        in = readArray(in, ast.strings.data(), ast.strings.size());
+        readArray(in, ast.text.data(), ast.text.size());
+        ast.callCaches.assign(ast.callSites, CallCache{nullptr, 0});
+        return ast;
+    }
 
-        // Parse and evaluate the tokens only if there are tokens to parse
-        if (!tokens.empty())
+    // the saved parts are byte for byte the same, the inline caches are not compared
+    bool sameAs(const FlatAst &other) const
+    {
+        return root == other.root && callSites == other.callSites && sameArray(nodes, other.nodes) &&
+               sameArray(lists, other.lists) && sameArray(ranges, other.ranges) && sameArray(strings, other.strings) &&
+               sameArray(text, other.text);
+    }
+
+private:
+    template <typename T>
+    static char *writeArray(char *out, const T *items, size_t count)
+    {
+        static_assert(is_trivially_copyable<T>::value, "only plain data is saved");
+        if (count > 0)
         {
-            // Check if the first token is an IF token (the first level)
-            if (tokens[0].type == IF)
-            {
-                // Parse the tokens
-                Parser parser(tokens);
-                Node *ast = parser.parse();
-                if (ast == nullptr)
-                {
-                    cerr << "Error parsing line: " << line << endl;
-                    return 1;
-                }
+            memcpy(out, items, count * sizeof(T));
+        }
+        return out + count * sizeof(T);
+    }
+    template <typename T>
+    static const char *readArray(const char *in, T *items, size_t count)
+    {
+        if (count > 0)
+        {
+            memcpy(items, in, count * sizeof(T));
+        }
+        return in + count * sizeof(T);
+    }
+    template <typename T>
+    static bool sameArray(const vector<T> &a, const vector<T> &b)
+    {
+        return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+    }
 
-                // Evaluate the AST with the symbol table
-                bool result = Interpreter::evaluate(ast, symbolTable);
-                if (!result)
-                {
-                    // Set flag to skip if statement
-                    // else it will continue and skipStatement = false;
-                    skipStatement = true;
-                    elseCase = true;
-                }
-                delete ast;
+    uint32_t push(NodeKind kind, uint8_t op, bool local, int32_t value, uint32_t first, uint32_t second)
+    {
+        nodes.push_back(FlatNode{(uint8_t)kind, op, (uint8_t)local, 0, value, first, second});
+        return (uint32_t)nodes.size() - 1;
+    }
+
+    uint32_t addList(const vector<uint32_t> &items)
+    {
+        uint32_t list = (uint32_t)lists.size();
+        lists.push_back((uint32_t)items.size());
+        lists.insert(lists.end(), items.begin(), items.end());
+        return list;
+    }
+
+    // the indices of the items wait on scratch while their subtrees are added, nested lists stack above them
+    template <typename Item>
+    uint32_t addNodes(const ArenaArray<Item *> &items)
+    {
+        size_t base = scratch.size();
+        for (const Item *item : items)
+        {
+            uint32_t index = add(item);
+            scratch.push_back(index);
+        }
+        uint32_t list = (uint32_t)lists.size();
+        lists.push_back((uint32_t)items.size());
+        lists.insert(lists.end(), scratch.begin() + base, scratch.end());
+        scratch.resize(base);
+        return list;
+    }
+
+    int addString(string_view value)
+    {
+        strings.push_back(FlatString{(uint32_t)text.size(), (uint32_t)value.size()});
+        text.insert(text.end(), value.begin(), value.end());
+        return (int)strings.size() - 1;
+    }
+
+    uint32_t add(const Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_NUMBER:
+            return push(NODE_NUMBER, 0, false, static_cast<const NumberNode *>(node)->value, 0, 0);
+        case NODE_IDENTIFIER:
+        {
+            const IdentifierNode *identifier = static_cast<const IdentifierNode *>(node);
+            return push(NODE_IDENTIFIER, 0, identifier->local, identifier->slot, 0, 0);
+        }
+        case NODE_BINOP:
+        {
+            const BinOpNode *binOpNode = static_cast<const BinOpNode *>(node);
+            uint32_t left = add(binOpNode->leftNode);
+            uint32_t right = add(binOpNode->rightNode);
+            return push(NODE_BINOP, (uint8_t)binOpNode->op, false, 0, left, right);
+        }
+        case NODE_ASSIGNMENT:
+        {
+            const AssignmentNode *assignmentNode = static_cast<const AssignmentNode *>(node);
+            uint32_t expression = add(assignmentNode->expression);
+            return push(NODE_ASSIGNMENT, 0, assignmentNode->variable->local, assignmentNode->variable->slot, expression, 0);
+        }
+        case NODE_STRING:
+            return push(NODE_STRING, 0, false, addString(static_cast<const StringNode *>(node)->getValue()), 0, 0);
+        case NODE_PRINT:
+            return push(NODE_PRINT, 0, false, 0, addNodes(static_cast<const PrintNode *>(node)->getArguments()), 0);
+        case NODE_FUNC_CALL:
+        {
+            const func_call *call = static_cast<const func_call *>(node);
+            return push(NODE_FUNC_CALL, 0, false, call->get_func_id(), addNodes(call->get_arguments()), callSites++);
+        }
+        case NODE_RETURN:
+        {
+            const Node *value = static_cast<const returnNode *>(node)->getValue();
+            return push(NODE_RETURN, 0, false, 0, value != nullptr ? add(value) : NO_NODE, 0);
+        }
+        case NODE_BLOCK:
+            return push(NODE_BLOCK, 0, false, 0, addNodes(static_cast<const BlockNode *>(node)->getStatements()), 0);
+        case NODE_IF:
+        {
+            const IfNode *ifNode = static_cast<const IfNode *>(node);
+            uint32_t condition = add(ifNode->getCondition());
+            uint32_t thenBlock = add(ifNode->getThenBlock());
+            uint32_t elseBlock = ifNode->getElseBlock() != nullptr ? add(ifNode->getElseBlock()) : NO_NODE;
+            return push(NODE_IF, 0, false, (int32_t)elseBlock, condition, thenBlock);
+        }
+        case NODE_WHILE:
+        {
+            const WhileNode *whileNode = static_cast<const WhileNode *>(node);
+            uint32_t condition = add(whileNode->getCondition());
+            return push(NODE_WHILE, 0, false, 0, condition, add(whileNode->getBody()));
+        }
+        case NODE_FOR_RANGE:
+        {
+            const ForRangeNode *forNode = static_cast<const ForRangeNode *>(node);
+            FlatRange range;
+            range.slots = rangeSlots(forNode);
+            range.start = add(forNode->getStart());
+            range.stop = add(forNode->getStop());
+            range.step = forNode->getStep() != nullptr ? add(forNode->getStep()) : NO_NODE;
+            range.body = add(forNode->getBody());
+            ranges.push_back(range);
+            return push(NODE_FOR_RANGE, 0, false, (int32_t)ranges.size() - 1, 0, 0);
+        }
+        case NODE_FUNC_DEF:
+        {
+            const FuncDefNode *funcDef = static_cast<const FuncDefNode *>(node);
+            vector<uint32_t> parameters;
+            for (const IdentifierNode *param : funcDef->getDeclaration()->get_parameters())
+            {
+                parameters.push_back((uint32_t)param->id);
+            }
+            uint32_t list = addList(parameters);
+            return push(NODE_FUNC_DEF, 0, false, funcDef->getDeclaration()->func_name->id, list, addString(funcDef->getBody()));
+        }
+        case NODE_FLUSH:
+        case NODE_BREAK:
+        case NODE_CONTINUE:
+            return push(node->kind, 0, false, 0, 0, 0);
+        default:
+            cerr << "Error: Unexpected node" << endl;
+            exit(1);
+        }
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  INTERPRETER
+//////////////////////////////////////////////////////////////////////////////////
+// + - and * of the language wrap around in two's complement on every engine
+// signed overflow is undefined in C++, so they are computed in unsigned
+static inline int wrappingAdd(int a, int b)
+{
+    return (int)((unsigned)a + (unsigned)b);
+}
+static inline int wrappingSub(int a, int b)
+{
+    return (int)((unsigned)a - (unsigned)b);
+}
+static inline int wrappingMul(int a, int b)
+{
+    return (int)((unsigned)a * (unsigned)b);
+}
+
+// runs the body of the function a call expression names and returns the value of the call
+class FunctionCaller
+{
+public:
+    virtual ~FunctionCaller() {}
+    virtual int callFunction(const FlatAst &ast, const FlatNode &call) = 0;
+};
+
+class Interpreter
+{
+public:
+    // set by the executor that runs the program, calls met while evaluating an expression go to it
+    static FunctionCaller *functionCaller;
+
+    static int evaluate(const FlatAst &ast, uint32_t index, SymbolTable &symbolTable)
+    {
+        if (index == NO_NODE)
+        {
+            cerr << "Error: Empty AST" << endl;
+            exit(1);
+        }
+
+        return evaluateNode(ast, index, symbolTable);
+    }
+
+    static int readVariable(int slot, bool local, SymbolTable &symbolTable)
+    {
+        return local ? symbolTable.getLocal(slot) : symbolTable.getGlobal(slot);
+    }
+    static void writeVariable(int slot, bool local, int value, SymbolTable &symbolTable)
+    {
+        if (local)
+        {
+            symbolTable.setLocal(slot, value);
+        }
+        else
+        {
+            symbolTable.setGlobal(slot, value);
+        }
+    }
+
+    // the value of one binary operator, also what the optimizer folds constants with
+    static int binaryOperation(TokenType op, int leftValue, int rightValue)
+    {
+        switch (op)
+        {
+        case PLUS:
+            return wrappingAdd(leftValue, rightValue);
+        case MINUS:
+            return wrappingSub(leftValue, rightValue);
+        case MULTIPLY:
+            return wrappingMul(leftValue, rightValue);
+        case DIVIDE:
+            if (rightValue == 0)
+            {
+                cerr << "Error: Division by zero" << endl;
+                exit(1);
+            }
+            // the one quotient an int cannot hold, the division would trap
+            if (rightValue == -1 && leftValue == INT_MIN)
+            {
+                cerr << "Error: Integer overflow in division" << endl;
+                exit(1);
             }
-            else if (tokens[0].type == ELSE)
+            return leftValue / rightValue;
+        // return 1 for true and 0 for false
+        case DOUBLE_EQUAL:
+            return leftValue == rightValue;
+        case LESS_THAN:
+            return leftValue < rightValue;
+        case LESS_THAN_OR_EQUAL_TO:
+            return leftValue <= rightValue;
+        case GREATER_THAN:
+            return leftValue > rightValue;
+        case GREATER_THAN_OR_EQUAL_TO:
+            return leftValue >= rightValue;
+        default:
+            cerr << "Error: Unknown operator" << endl;
+            exit(1);
+        }
+    }
+
+    // store the start, stop and step of a range loop in its hidden slots, false when the range is empty
+    static bool startRange(const RangeSlots &loop, int start, int stop, int step, SymbolTable &symbolTable)
+    {
+        if (step == 0)
+        {
+            cerr << "Error: range() step must not be zero" << endl;
+            exit(1);
+        }
+        writeVariable(loop.counterSlot, loop.hiddenLocal, start, symbolTable);
+        writeVariable(loop.stopSlot, loop.hiddenLocal, stop, symbolTable);
+        writeVariable(loop.stepSlot, loop.hiddenLocal, step, symbolTable);
+        if (step > 0 ? start >= stop : start <= stop)
+        {
+            return false;
+        }
+        writeVariable(loop.variableSlot, loop.variableLocal, start, symbolTable);
+        return true;
+    }
+    // move the counter by the step and copy it to the variable, false once it reaches stop
+    // the sum is taken in 64 bits so a counter close to the int limits cannot wrap around
+    static bool nextRange(const RangeSlots &loop, SymbolTable &symbolTable)
+    {
+        int step = readVariable(loop.stepSlot, loop.hiddenLocal, symbolTable);
+        int stop = readVariable(loop.stopSlot, loop.hiddenLocal, symbolTable);
+        long long counter = (long long)readVariable(loop.counterSlot, loop.hiddenLocal, symbolTable) + step;
+        if (step > 0 ? counter >= stop : counter <= stop)
+        {
+            return false;
+        }
+        writeVariable(loop.counterSlot, loop.hiddenLocal, (int)counter, symbolTable);
+        writeVariable(loop.variableSlot, loop.variableLocal, (int)counter, symbolTable);
+        return true;
+    }
+
+private:
+    // this will evaluate the parse list
+    static int evaluateNode(const FlatAst &ast, uint32_t index, SymbolTable &symbolTable)
+    {
+        const FlatNode &node = ast.nodes[index];
+        switch (node.kind)
+        {
+        case NODE_NUMBER:
+            return node.value;
+        case NODE_IDENTIFIER:
+            return readVariable(node.value, node.local, symbolTable);
+        case NODE_BINOP:
+        {
+            int leftValue = evaluateNode(ast, node.first, symbolTable);
+            int rightValue = evaluateNode(ast, node.second, symbolTable);
+            return binaryOperation((TokenType)node.op, leftValue, rightValue);
+        }
+        case NODE_ASSIGNMENT:
+        {
+            int assignedValue = evaluateNode(ast, node.first, symbolTable);
+            writeVariable(node.value, node.local, assignedValue, symbolTable);
+            return assignedValue;
+        }
+        // this node is for the print function
+        case NODE_PRINT:
+        {
+            const uint32_t *begin = ast.listBegin(node.first);
+            const uint32_t *end = ast.listEnd(node.first);
+            for (const uint32_t *argument = begin; argument != end; ++argument)
             {
-                if (elseCase == true)
+                const FlatNode &argumentNode = ast.nodes[*argument];
+                if (argumentNode.kind == NODE_STRING)
                 {
-                    elseCase = false;
-                    continue;
+                    output.writeString(ast.getString(argumentNode.value));
                 }
-                // skip else statement if it's not an else case
                 else
                 {
-                    skipStatement = true;
+                    // Evaluate and print other types of nodes
+                    output.writeInt(evaluateNode(ast, *argument, symbolTable));
                 }
+
+                // Print a space after each argument except for the last one
+                if (argument + 1 != end)
+                    output.writeChar(' ');
             }
-            else if (tokens[0].type == DEF)
+            output.endLine(); // Print newline after printing all arguments
+            return 0;
+        }
+        case NODE_FLUSH:
+            output.flush();
+            return 0;
+        case NODE_FUNC_CALL:
+            return functionCaller->callFunction(ast, node);
+        default:
+            cerr << "Error: Unexpected node" << endl;
+            exit(1);
+        }
+        return 0;
+    }
+};
+
+FunctionCaller *Interpreter::functionCaller = nullptr;
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  OPTIMIZER
+//////////////////////////////////////////////////////////////////////////////////
+// folds constant subtrees, drops operations that leave their operand unchanged (x * 1, x + 0, ...)
+// and replaces an if whose condition is constant by the branch that runs
+// it works on a resolved unit, so a pruned branch still decides which names of a function are locals
+class Optimizer
+{
+private:
+    Arena &arena;
+
+    Optimizer(Arena &arena) : arena(arena) {}
+
+public:
+    static bool dumpTrees; // --dump-ast prints every unit before and after the pass to stderr
+
+    // returns the optimized block, new nodes are allocated in the arena of the unit
+    static BlockNode *optimize(BlockNode *block, Arena &arena, const string &unit)
+    {
+        if (dumpTrees)
+        {
+            dump(unit, "before", block);
+        }
+        Optimizer optimizer(arena);
+        block = optimizer.optimizeBlock(block);
+        if (dumpTrees)
+        {
+            dump(unit, "after", block);
+        }
+        return block;
+    }
+
+private:
+    static void dump(const string &unit, const char *when, const BlockNode *block)
+    {
+        // the nodes print to cout, which is pointed at stderr after what print() buffered is written
+        output.flush();
+        streambuf *previous = cout.rdbuf(cerr.rdbuf());
+        cout << "=== " << unit << " " << when << " optimizing ===" << endl;
+        block->print();
+        cout << endl;
+        cout.rdbuf(previous);
+    }
+
+    static bool isNumber(const Node *node, int value)
+    {
+        return node->kind == NODE_NUMBER && static_cast<const NumberNode *>(node)->value == value;
+    }
+
+    BlockNode *optimizeBlock(BlockNode *block)
+    {
+        vector<Node *> statements;
+        for (Node *statement : block->getStatements())
+        {
+            statement = optimizeStatement(statement);
+            // an if with a constant condition leaves the statements of the branch that runs
+            if (statement->kind == NODE_IF && static_cast<IfNode *>(statement)->getCondition()->kind == NODE_NUMBER)
             {
-                function_block = true;
-                func_name = tokens[1].value;
-                Parser parser(tokens);
-                Node *ast = parser.parse();
-                if (ast == nullptr)
+                IfNode *ifNode = static_cast<IfNode *>(statement);
+                BlockNode *branch = static_cast<NumberNode *>(ifNode->getCondition())->value != 0 ? ifNode->getThenBlock() : ifNode->getElseBlock();
+                if (branch != nullptr)
                 {
-                    cerr << "Error parsing line: " << line << endl;
-                    return 1;
+                    statements.insert(statements.end(), branch->getStatements().begin(), branch->getStatements().end());
                 }
-                // Evaluate the AST with the symbol table
-                Interpreter::evaluate(ast, symbolTable);
-                // Delete the AST
-                delete ast;
+                continue;
             }
-            else if (tokens[2].type == CALL_FUNC || tokens[4].type == CALL_FUNC || tokens[6].type == CALL_FUNC || tokens[8].type == CALL_FUNC || tokens[10].type == CALL_FUNC || tokens[12].type == CALL_FUNC)
+            // so does a while loop that never runs
+            if (statement->kind == NODE_WHILE && isNumber(static_cast<WhileNode *>(statement)->getCondition(), 0))
             {
-                string func_name;
-                if (tokens[2].type == CALL_FUNC)
-                {
-                    func_name = tokens[2].value;
-                }
-                else if (tokens[4].type == CALL_FUNC)
-                {
-                    func_name = tokens[4].value;
-                }
-                else if (tokens[6].type == CALL_FUNC)
-                {
-                    func_name = tokens[6].value;
-                }
-                else if (tokens[8].type == CALL_FUNC)
-                {
-                    func_name = tokens[8].value;
-                }
-                else if (tokens[10].type == CALL_FUNC)
-                {
-                    func_name = tokens[10].value;
-                }
-                else if (tokens[12].type == CALL_FUNC)
-                {
-                    func_name = tokens[12].value;
-                }
-                stringstream newFuncBlock(funcBlockMap[func_name]);
-                Parser parser(tokens);
-                Node *ast = parser.parse();
-                if (ast == nullptr)
-                {
-                    cerr << "Error parsing line: " << line << endl;
-                    return 1;
-                }
-                // Evaluate the AST with the symbol table
-                Interpreter::evaluate(ast, symbolTable);
-                // Delete the AST
-                delete ast;
-
-                bool localSkipStatement = false;
-                bool localElseCase = false;
-                // innitialize the flags to indicate if the it's first or second level if else statement (2 levels)
-                bool local_first_lv_if = false;
-                bool local_first_lv_else = false;
-                bool local_second_lv_if = false;
-                bool local_second_lv_else = false;
-
-                while (getline(newFuncBlock, line))
-                {
-                    // Skip empty lines or lines containing only comments
-                    if (!line.empty() && line[0] == ' ' && line.find_first_not_of(" \t") != std::string::npos && line.find_first_not_of(" \t") == line.find('#'))
-                    {
-                        // The line starts with a white space and is a comment
-                        continue;
-                    }
-                    // skip first level if else statement
-                    if (localSkipStatement == true && (local_first_lv_if || local_first_lv_else) && !local_second_lv_if && !local_second_lv_else)
-                    {
-                        // cout << line << endl;
-                        if (!line.empty() && line[0] == ' ')
-                        {
-                            continue;
-                        }
-                        else
-                        {
-                            localSkipStatement = false;
-                        }
-                    }
-                    // set first level if flag to true
-                    else if (!line.empty() && line[0] == 'i' && line[1] == 'f' && !local_first_lv_if)
-                    {
-                        // cout << line << endl;
-                        local_first_lv_if = true;
-                        local_first_lv_else = false;
-                        local_second_lv_if = false;
-                        local_second_lv_else = false;
-                    }
-                    // set first level else flag to true
-                    else if (!line.empty() && line[0] == 'e' && line[1] == 'l' && line[2] == 's' && line[3] == 'e' && !local_first_lv_else)
-                    {
-                        // cout << line << endl;
-                        local_first_lv_else = true;
-                        local_first_lv_if = false;
-                        local_second_lv_if = false;
-                        local_second_lv_else = false;
-                    }
-                    // set second level if flag to true
-                    else if (!line.empty() && line[0] == ' ' && line[4] == 'i' && line[5] == 'f')
-                    {
-                        // cout << line << endl;
-                        local_second_lv_if = true;
-                        local_second_lv_else = false;
-                    }
-                    // set second level else flag to true
-                    else if (!line.empty() && line[0] == ' ' && line[4] == 'e' && line[5] == 'l' && line[6] == 's' && line[7] == 'e')
-                    {
-                        // cout << line << endl;
-                        local_second_lv_else = true;
-                        local_second_lv_if = false;
-                    }
-                    // skip second level if
-                    if (localSkipStatement == true && local_second_lv_if)
-                    {
-                        if (!line.empty() && line[0] == ' ' && !local_second_lv_else)
-                        {
-                            // cout << line << endl;
-                            continue;
-                        }
-                        else
-                        {
-                            localSkipStatement = false;
-                        }
-                    }
-                    // skip second level else
-                    if (localSkipStatement == true && local_second_lv_else)
-                    {
-                        // cout << line << endl;
-                        if (!line.empty() && line[0] == ' ' && line[4] == ' ' && !local_second_lv_if)
-                        {
-                            // cout << line << endl;
-                            continue;
-                        }
-                        else
-                        {
-                            localSkipStatement = false;
-                        }
-                    }
-                    // Tokenize the line
-                    Lexer lexer(line);
-                    lexer.tokenize(symbolTable);
-                    const vector<Token> &tokens = lexer.getTokens();
-                    // for (const Token &token : tokens)
-                    // {
-                    //     cout << "value: " << token.value << " Type: " << token.type << endl;
-                    // }
-
-                    // Parse and evaluate the tokens only if there are tokens to parse
-                    if (!tokens.empty())
-                    {
-                        // Check if the first token is an IF token (the first level)
-                        if (tokens[0].type == IF)
-                        {
-                            // Parse the tokens
-                            Parser parser(tokens);
-                            Node *ast = parser.parse();
-                            if (ast == nullptr)
-                            {
-                                cerr << "Error parsing line: " << line << endl;
-                                return 1;
-                            }
-
-                            // Evaluate the AST with the symbol table
-                            bool result = Interpreter::evaluate(ast, symbolTable);
-                            if (!result)
-                            {
-                                // Set flag to skip if statement
-                                // else it will continue and localSkipStatement = false;
-                                localSkipStatement = true;
-                                localElseCase = true;
-                            }
-                            delete ast;
-                        }
-                        else if (tokens[0].type == ELSE)
-                        {
-                            if (localElseCase == true)
-                            {
-                                localElseCase = false;
-                                continue;
-                            }
-                            // skip else statement if it's not an else case
-                            else
-                            {
-                                localSkipStatement = true;
-                            }
-                        }
-                        else if (tokens[0].type == RETURN)
-                        {
-                            // Parse the tokens
-                            Parser parser(tokens);
-                            Node *ast = parser.parse();
-                            if (ast == nullptr)
-                            {
-                                cerr << "Error parsing line: " << line << endl;
-                                return 1;
-                            }
-                            // Evaluate the AST with the symbol table
-                            Interpreter::evaluate(ast, symbolTable);
-                            // symbolTable.printLocalVars();
-                            // symbolTable.printFuncInit();
-                            // Delete the AST
-                            delete ast;
-                        }
-                        else if (tokens[2].type == CALL_FUNC || tokens[4].type == CALL_FUNC || tokens[6].type == CALL_FUNC || tokens[8].type == CALL_FUNC || tokens[10].type == CALL_FUNC || tokens[12].type == CALL_FUNC)
-                        {
-                            string func_name;
-                            if (tokens[2].type == CALL_FUNC)
-                            {
-                                func_name = tokens[2].value;
-                            }
-                            else if (tokens[4].type == CALL_FUNC)
-                            {
-                                func_name = tokens[4].value;
-                            }
-                            else if (tokens[6].type == CALL_FUNC)
-                            {
-                                func_name = tokens[6].value;
-                            }
-                            else if (tokens[8].type == CALL_FUNC)
-                            {
-                                func_name = tokens[8].value;
-                            }
-                            else if (tokens[10].type == CALL_FUNC)
-                            {
-                                func_name = tokens[10].value;
-                            }
-                            else if (tokens[12].type == CALL_FUNC)
-                            {
-                                func_name = tokens[12].value;
-                            }
-                            stringstream newFuncBlock(funcBlockMap[func_name]);
-                            Parser parser(tokens);
-                            Node *ast = parser.parse();
-                            if (ast == nullptr)
-                            {
-                                cerr << "Error parsing line: " << line << endl;
-                                return 1;
-                            }
-                            // Evaluate the AST with the symbol table
-                            Interpreter::evaluate(ast, symbolTable);
-                            // Delete the AST
-                            delete ast;
-
-                            bool localSkipStatement = false;
-                            bool localElseCase = false;
-                            // innitialize the flags to indicate if the it's first or second level if else statement (2 levels)
-                            bool local_first_lv_if = false;
-                            bool local_first_lv_else = false;
-                            bool local_second_lv_if = false;
-                            bool local_second_lv_else = false;
-
-                            while (getline(newFuncBlock, line))
-                            {
-                                // Skip empty lines or lines containing only comments
-                                if (!line.empty() && line[0] == ' ' && line.find_first_not_of(" \t") != std::string::npos && line.find_first_not_of(" \t") == line.find('#'))
-                                {
-                                    // The line starts with a white space and is a comment
-                                    continue;
-                                }
-                                // skip first level if else statement
-                                if (localSkipStatement == true && (local_first_lv_if || local_first_lv_else) && !local_second_lv_if && !local_second_lv_else)
-                                {
-                                    // cout << line << endl;
-                                    if (!line.empty() && line[0] == ' ')
-                                    {
-                                        continue;
-                                    }
-                                    else
-                                    {
-                                        localSkipStatement = false;
-                                    }
-                                }
-                                // set first level if flag to true
-                                else if (!line.empty() && line[0] == 'i' && line[1] == 'f' && !local_first_lv_if)
-                                {
-                                    // cout << line << endl;
-                                    local_first_lv_if = true;
-                                    local_first_lv_else = false;
-                                    local_second_lv_if = false;
-                                    local_second_lv_else = false;
-                                }
-                                // set first level else flag to true
-                                else if (!line.empty() && line[0] == 'e' && line[1] == 'l' && line[2] == 's' && line[3] == 'e' && !local_first_lv_else)
-                                {
-                                    // cout << line << endl;
-                                    local_first_lv_else = true;
-                                    local_first_lv_if = false;
-                                    local_second_lv_if = false;
-                                    local_second_lv_else = false;
-                                }
-                                // set second level if flag to true
-                                else if (!line.empty() && line[0] == ' ' && line[4] == 'i' && line[5] == 'f')
-                                {
-                                    // cout << line << endl;
-                                    local_second_lv_if = true;
-                                    local_second_lv_else = false;
-                                }
-                                // set second level else flag to true
-                                else if (!line.empty() && line[0] == ' ' && line[4] == 'e' && line[5] == 'l' && line[6] == 's' && line[7] == 'e')
-                                {
-                                    // cout << line << endl;
-                                    local_second_lv_else = true;
-                                    local_second_lv_if = false;
-                                }
-                                // skip second level if
-                                if (localSkipStatement == true && local_second_lv_if)
-                                {
-                                    if (!line.empty() && line[0] == ' ' && !local_second_lv_else)
-                                    {
-                                        // cout << line << endl;
-                                        continue;
-                                    }
-                                    else
-                                    {
-                                        localSkipStatement = false;
-                                    }
-                                }
-                                // skip second level else
-                                if (localSkipStatement == true && local_second_lv_else)
-                                {
-                                    // cout << line << endl;
-                                    if (!line.empty() && line[0] == ' ' && line[4] == ' ' && !local_second_lv_if)
-                                    {
-                                        // cout << line << endl;
-                                        continue;
-                                    }
-                                    else
-                                    {
-                                        localSkipStatement = false;
-                                    }
-                                }
-                                // Tokenize the line
-                                Lexer lexer(line);
-                                lexer.tokenize(symbolTable);
-                                const vector<Token> &tokens = lexer.getTokens();
-                                // for (const Token &token : tokens)
-                                // {
-                                //     cout << token.value << endl;
-                                // }
-
-                                // Parse and evaluate the tokens only if there are tokens to parse
-                                if (!tokens.empty())
-                                {
-                                    // Check if the first token is an IF token (the first level)
-                                    if (tokens[0].type == IF)
-                                    {
-                                        // Parse the tokens
-                                        Parser parser(tokens);
-                                        Node *ast = parser.parse();
-                                        if (ast == nullptr)
-                                        {
-                                            cerr << "Error parsing line: " << line << endl;
-                                            return 1;
-                                        }
-
-                                        // Evaluate the AST with the symbol table
-                                        bool result = Interpreter::evaluate(ast, symbolTable);
-                                        if (!result)
-                                        {
-                                            // Set flag to skip if statement
-                                            // else it will continue and localSkipStatement = false;
-                                            localSkipStatement = true;
-                                            localElseCase = true;
-                                        }
-                                        delete ast;
-                                    }
-                                    else if (tokens[0].type == ELSE)
-                                    {
-                                        if (localElseCase == true)
-                                        {
-                                            localElseCase = false;
-                                            continue;
-                                        }
-                                        // skip else statement if it's not an else case
-                                        else
-                                        {
-                                            localSkipStatement = true;
-                                        }
-                                    }
-                                    else if (tokens[0].type == RETURN)
-                                    {
-                                        // Parse the tokens
-                                        Parser parser(tokens);
-                                        Node *ast = parser.parse();
-                                        if (ast == nullptr)
-                                        {
-                                            cerr << "Error parsing line: " << line << endl;
-                                            return 1;
-                                        }
-                                        // Evaluate the AST with the symbol table
-                                        Interpreter::evaluate(ast, symbolTable);
-                                        // symbolTable.printLocalVars();
-                                        // symbolTable.printFuncInit();
-                                        // Delete the AST
-                                        delete ast;
-                                    }
-                                    // parse and evaluate if not if or else statement
-                                    else
-                                    {
-                                        // Parse the tokens
-                                        Parser parser(tokens);
-                                        Node *ast = parser.parse();
-                                        if (ast == nullptr)
-                                        {
-                                            cerr << "Error parsing line: " << line << endl;
-                                            return 1;
-                                        }
-                                        // Evaluate the AST with the symbol table
-                                        Interpreter::evaluate(ast, symbolTable);
-
-                                        // Delete the AST
-                                        delete ast;
-                                    }
-                                }
-                            }
-                        }
-                        // parse and evaluate if not if or else statement
-                        else
-                        {
-                            // Parse the tokens
-                            Parser parser(tokens);
-                            Node *ast = parser.parse();
-                            if (ast == nullptr)
-                            {
-                                cerr << "Error parsing line: " << line << endl;
-                                return 1;
-                            }
-                            // Evaluate the AST with the symbol table
-                            Interpreter::evaluate(ast, symbolTable);
-
-                            // Delete the AST
-                            delete ast;
-                        }
-                    }
-                }
+                continue;
             }
-            // parse and evaluate if not if or else statement
-            else
+            statements.push_back(statement);
+        }
+        return arena.make<BlockNode>(arena.makeArray(statements));
+    }
+
+    Node *optimizeStatement(Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_IF:
+        {
+            IfNode *ifNode = static_cast<IfNode *>(node);
+            BlockNode *elseBlock = ifNode->getElseBlock() != nullptr ? optimizeBlock(ifNode->getElseBlock()) : nullptr;
+            return arena.make<IfNode>(fold(ifNode->getCondition()), optimizeBlock(ifNode->getThenBlock()), elseBlock);
+        }
+        case NODE_WHILE:
+        {
+            WhileNode *whileNode = static_cast<WhileNode *>(node);
+            return arena.make<WhileNode>(fold(whileNode->getCondition()), optimizeBlock(whileNode->getBody()));
+        }
+        case NODE_FOR_RANGE:
+        {
+            ForRangeNode *forNode = static_cast<ForRangeNode *>(node);
+            Node *step = forNode->getStep() != nullptr ? fold(forNode->getStep()) : nullptr;
+            ForRangeNode *folded = arena.make<ForRangeNode>(forNode->getVariable(), fold(forNode->getStart()), fold(forNode->getStop()), step);
+            folded->counterSlot = forNode->counterSlot;
+            folded->stopSlot = forNode->stopSlot;
+            folded->stepSlot = forNode->stepSlot;
+            folded->hiddenLocal = forNode->hiddenLocal;
+            folded->setBody(optimizeBlock(forNode->getBody()));
+            return folded;
+        }
+        case NODE_RETURN:
+        {
+            Node *value = static_cast<returnNode *>(node)->getValue();
+            return value != nullptr ? arena.make<returnNode>(fold(value)) : node;
+        }
+        default:
+            return fold(node);
+        }
+    }
+
+    // fold the expression below node, the result replaces node in its parent
+    Node *fold(Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_BINOP:
+        {
+            BinOpNode *binOpNode = static_cast<BinOpNode *>(node);
+            binOpNode->leftNode = fold(binOpNode->leftNode);
+            binOpNode->rightNode = fold(binOpNode->rightNode);
+            Node *left = binOpNode->leftNode;
+            Node *right = binOpNode->rightNode;
+            if (left->kind == NODE_NUMBER && right->kind == NODE_NUMBER)
             {
-                // Parse the tokens
-                Parser parser(tokens);
-                Node *ast = parser.parse();
-                if (ast == nullptr)
+                // a division by a constant 0 or INT_MIN / -1 is left in place so the error is raised when it runs
+                if (binOpNode->op == DIVIDE &&
+                    (isNumber(right, 0) || (isNumber(right, -1) && isNumber(left, INT_MIN))))
                 {
-                    cerr << "Error parsing line: " << line << endl;
-                    return 1;
+                    return node;
                 }
-                // Evaluate the AST with the symbol table
-                Interpreter::evaluate(ast, symbolTable);
-                // symbolTable.printGlobalVars();
-
-                // Delete the AST
-                delete ast;
+                // computed by the interpreter itself so a folded value is exactly what the program would compute
+                return arena.make<NumberNode>(Interpreter::binaryOperation(binOpNode->op, static_cast<NumberNode *>(left)->value,
+                                                                           static_cast<NumberNode *>(right)->value));
             }
-        }
+            // a string operand is an error when the operator runs, dropping the operator would hide it
+            if (left->kind == NODE_STRING || right->kind == NODE_STRING)
+            {
+                return node;
+            }
+            switch (binOpNode->op)
+            {
+            case PLUS:
+                if (isNumber(left, 0))
+                    return right;
+                if (isNumber(right, 0))
+                    return left;
+                break;
+            case MINUS:
+                if (isNumber(right, 0))
+                    return left;
+                break;
+            case MULTIPLY:
+                if (isNumber(left, 1))
+                    return right;
+                if (isNumber(right, 1))
+                    return left;
+                break;
+            case DIVIDE:
+                if (isNumber(right, 1))
+                    return left;
+                break;
+            default:
+                break;
+            }
+            return node;
+        }
+        case NODE_ASSIGNMENT:
+        {
+            AssignmentNode *assignmentNode = static_cast<AssignmentNode *>(node);
+            assignmentNode->expression = fold(assignmentNode->expression);
+            return node;
+        }
+        case NODE_PRINT:
+            for (Node *&argument : static_cast<PrintNode *>(node)->getArguments())
+            {
+                argument = fold(argument);
+            }
+            return node;
+        case NODE_FUNC_CALL:
+            for (Node *&argument : static_cast<func_call *>(node)->get_arguments())
+            {
+                argument = fold(argument);
+            }
+            return node;
+        default:
+            return node;
+        }
+    }
+};
+
+bool Optimizer::dumpTrees = false;
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  BYTECODE
+//////////////////////////////////////////////////////////////////////////////////
+enum OpCode
+{
+    OP_CONST,           // push operand
+    OP_LOAD_GLOBAL,     // push the global in slot operand
+    OP_LOAD_LOCAL,      // push the local in slot operand of the running frame
+    OP_STORE_GLOBAL,    // pop into the global in slot operand
+    OP_STORE_LOCAL,     // pop into the local in slot operand
+    OP_DUP,             // push a copy of the top of the stack
+    OP_POP,             // drop the top of the stack
+    OP_ADD,             // binary operators pop right then left and push the result
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_EQ,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_JUMP,            // continue at operand
+    OP_JUMP_IF_FALSE,   // pop, continue at operand if it is 0
+    OP_PRINT_STRING,    // write strings[operand]
+    OP_PRINT_VALUE,     // pop and write the value
+    OP_PRINT_SPACE,     // separator between print arguments
+    OP_PRINT_NEWLINE,   // end of a print statement
+    OP_FLUSH,           // write out the buffered output
+    OP_DEF,             // declare functions[operand]
+    OP_CALL,            // pop the arguments of calls[operand], run the body in a new frame and push its value
+    OP_RETURN,          // pop the value of the call and leave the running function
+    OP_FOR_START,       // pop start, stop and step of ranges[operand], skip the loop if the range is empty
+    OP_FOR_NEXT,        // step the counter of ranges[operand] and run the body again until it reaches stop
+    // superinstructions for the shapes that dominate the scripts, --stats lists the most frequent instruction pairs
+    OP_ADD_CONST_LOCAL,  // x = x + value for the local in slot operand
+    OP_ADD_CONST_GLOBAL,
+    OP_ADD_LOCALS,       // push the sum of the locals in slots operand and value
+    OP_ADD_GLOBALS,
+    OP_LOCAL_EQ_JUMP,    // compare the local in slot value2 with value, continue at operand if it does not hold
+    OP_LOCAL_LT_JUMP,
+    OP_LOCAL_LE_JUMP,
+    OP_LOCAL_GT_JUMP,
+    OP_LOCAL_GE_JUMP,
+    OP_GLOBAL_EQ_JUMP,
+    OP_GLOBAL_LT_JUMP,
+    OP_GLOBAL_LE_JUMP,
+    OP_GLOBAL_GT_JUMP,
+    OP_GLOBAL_GE_JUMP,
+    OP_HALT
+};
+static constexpr int OP_COUNT = OP_HALT + 1;
+
+static const char *const opNames[OP_COUNT] = {
+    "CONST", "LOAD_GLOBAL", "LOAD_LOCAL", "STORE_GLOBAL", "STORE_LOCAL", "DUP", "POP",
+    "ADD", "SUB", "MUL", "DIV", "EQ", "LT", "LE", "GT", "GE", "JUMP", "JUMP_IF_FALSE",
+    "PRINT_STRING", "PRINT_VALUE", "PRINT_SPACE", "PRINT_NEWLINE", "FLUSH", "DEF", "CALL", "RETURN",
+    "FOR_START", "FOR_NEXT", "ADD_CONST_LOCAL", "ADD_CONST_GLOBAL", "ADD_LOCALS", "ADD_GLOBALS",
+    "LOCAL_EQ_JUMP", "LOCAL_LT_JUMP", "LOCAL_LE_JUMP", "LOCAL_GT_JUMP", "LOCAL_GE_JUMP",
+    "GLOBAL_EQ_JUMP", "GLOBAL_LT_JUMP", "GLOBAL_LE_JUMP", "GLOBAL_GT_JUMP", "GLOBAL_GE_JUMP", "HALT"};
+
+struct Instruction
+{
+    OpCode op;
+    int operand;
+    int value;  // second operand of the superinstructions
+    int value2; // third operand of the compare and jump superinstructions
+};
+
+// a range loop of a chunk with the positions of the first instruction of its body and the one after the loop
+struct RangeLoop
+{
+    RangeSlots slots;
+    size_t body;
+    size_t exit;
+};
+
+// linear code for one block plus the tables its operands index into
+struct Chunk
+{
+    vector<Instruction> code;
+    vector<string> strings;
+    vector<FuncDefNode *> functions;
+    vector<func_call *> calls;
+    vector<RangeLoop> ranges;
+    int maxStack; // values the chunk pushes at most, the VM makes room for them when it enters the chunk
+};
+
+// compiles a block from the front end into a Chunk, the nodes stay owned by the block
+class BytecodeCompiler
+{
+private:
+    Chunk *chunk;
+    int depth;
+    // jumps of the break and continue statements of every loop being compiled, patched at its end
+    struct LoopJumps
+    {
+        vector<size_t> breaks;
+        vector<size_t> continues;
+    };
+    vector<LoopJumps> loops;
+
+public:
+    static bool superinstructions; // off with --superinstructions=off, to compare
+
+    // a function body that runs off its end returns 0, the program halts
+    static Chunk *compile(const BlockNode *block, bool function)
+    {
+        BytecodeCompiler compiler;
+        compiler.compileBlock(block);
+        if (function)
+        {
+            compiler.emit(OP_CONST, 0);
+            compiler.emit(OP_RETURN, 0);
+        }
+        else
+        {
+            compiler.emit(OP_HALT, 0);
+        }
+        return compiler.chunk;
+    }
+
+private:
+    BytecodeCompiler() : chunk(new Chunk()), depth(0)
+    {
+        chunk->maxStack = 0;
+    }
+
+    // emit an instruction and return its position, the stack depth is tracked for the VM stack size
+    size_t emit(OpCode op, int operand, int value = 0, int value2 = 0)
+    {
+        switch (op)
+        {
+        case OP_CONST:
+        case OP_LOAD_GLOBAL:
+        case OP_LOAD_LOCAL:
+        case OP_DUP:
+        case OP_CALL: // the caller takes the arguments off first
+        case OP_ADD_LOCALS:
+        case OP_ADD_GLOBALS:
+            depth++;
+            break;
+        case OP_STORE_GLOBAL:
+        case OP_STORE_LOCAL:
+        case OP_POP:
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_EQ:
+        case OP_LT:
+        case OP_LE:
+        case OP_GT:
+        case OP_GE:
+        case OP_JUMP_IF_FALSE:
+        case OP_PRINT_VALUE:
+        case OP_RETURN:
+            depth--;
+            break;
+        case OP_FOR_START:
+            depth -= 3;
+            break;
+        default:
+            break;
+        }
+        chunk->maxStack = max(chunk->maxStack, depth);
+        chunk->code.push_back(Instruction{op, operand, value, value2});
+        return chunk->code.size() - 1;
+    }
+
+    void patchJump(size_t jump)
+    {
+        chunk->code[jump].operand = (int)chunk->code.size();
+    }
+    void patchJumps(const vector<size_t> &jumps, size_t target)
+    {
+        for (size_t jump : jumps)
+        {
+            chunk->code[jump].operand = (int)target;
+        }
+    }
+
+    void emitLoad(int slot, bool local)
+    {
+        emit(local ? OP_LOAD_LOCAL : OP_LOAD_GLOBAL, slot);
+    }
+    void emitStore(int slot, bool local)
+    {
+        emit(local ? OP_STORE_LOCAL : OP_STORE_GLOBAL, slot);
+    }
+
+    // the slot of a variable read, false when node is not one
+    static bool readsVariable(const Node *node, int &slot, bool &local)
+    {
+        if (node->kind != NODE_IDENTIFIER)
+        {
+            return false;
+        }
+        slot = static_cast<const IdentifierNode *>(node)->slot;
+        local = static_cast<const IdentifierNode *>(node)->local;
+        return true;
+    }
+
+    // compile the condition of an if or a while and return the jump taken when it is false, to be patched
+    // a variable compared with a constant is one instruction
+    size_t compileCondition(Node *condition)
+    {
+        int slot;
+        bool local;
+        if (superinstructions && condition->kind == NODE_BINOP)
+        {
+            BinOpNode *binOpNode = static_cast<BinOpNode *>(condition);
+            if (readsVariable(binOpNode->leftNode, slot, local) && binOpNode->rightNode->kind == NODE_NUMBER)
+            {
+                int value = static_cast<NumberNode *>(binOpNode->rightNode)->value;
+                int compare = -1;
+                switch (binOpNode->op)
+                {
+                case DOUBLE_EQUAL:
+                    compare = 0;
+                    break;
+                case LESS_THAN:
+                    compare = 1;
+                    break;
+                case LESS_THAN_OR_EQUAL_TO:
+                    compare = 2;
+                    break;
+                case GREATER_THAN:
+                    compare = 3;
+                    break;
+                case GREATER_THAN_OR_EQUAL_TO:
+                    compare = 4;
+                    break;
+                default:
+                    break;
+                }
+                if (compare >= 0)
+                {
+                    OpCode first = local ? OP_LOCAL_EQ_JUMP : OP_GLOBAL_EQ_JUMP;
+                    return emit((OpCode)(first + compare), 0, value, slot);
+                }
+            }
+        }
+        compileExpression(condition);
+        return emit(OP_JUMP_IF_FALSE, 0);
+    }
+
+    // x = x + constant and x = x - constant, true when the assignment was compiled that way
+    bool compileIncrement(const AssignmentNode *assignmentNode)
+    {
+        if (!superinstructions || assignmentNode->expression->kind != NODE_BINOP)
+        {
+            return false;
+        }
+        const BinOpNode *binOpNode = static_cast<const BinOpNode *>(assignmentNode->expression);
+        if (binOpNode->op != PLUS && binOpNode->op != MINUS)
+        {
+            return false;
+        }
+        const Node *variable = binOpNode->leftNode;
+        const Node *constant = binOpNode->rightNode;
+        if (binOpNode->op == PLUS && variable->kind == NODE_NUMBER)
+        {
+            swap(variable, constant);
+        }
+        int slot;
+        bool local;
+        if (constant->kind != NODE_NUMBER || !readsVariable(variable, slot, local) ||
+            slot != assignmentNode->variable->slot || local != assignmentNode->variable->local)
+        {
+            return false;
+        }
+        int value = static_cast<const NumberNode *>(constant)->value;
+        if (binOpNode->op == MINUS)
+        {
+            if (value == INT_MIN)
+            {
+                return false;
+            }
+            value = -value;
+        }
+        emit(local ? OP_ADD_CONST_LOCAL : OP_ADD_CONST_GLOBAL, slot, value);
+        return true;
+    }
+
+    void compileBlock(const BlockNode *block)
+    {
+        for (Node *statement : block->getStatements())
+        {
+            compileStatement(statement);
+        }
+    }
+
+    void compileStatement(Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_IF:
+        {
+            IfNode *ifNode = static_cast<IfNode *>(node);
+            size_t elseJump = compileCondition(ifNode->getCondition());
+            compileBlock(ifNode->getThenBlock());
+            if (ifNode->getElseBlock() != nullptr)
+            {
+                size_t endJump = emit(OP_JUMP, 0);
+                patchJump(elseJump);
+                compileBlock(ifNode->getElseBlock());
+                patchJump(endJump);
+            }
+            else
+            {
+                patchJump(elseJump);
+            }
+            break;
+        }
+        case NODE_WHILE:
+        {
+            WhileNode *whileNode = static_cast<WhileNode *>(node);
+            size_t top = chunk->code.size();
+            size_t exitJump = compileCondition(whileNode->getCondition());
+            loops.push_back(LoopJumps());
+            compileBlock(whileNode->getBody());
+            emit(OP_JUMP, (int)top);
+            patchJump(exitJump);
+            patchJumps(loops.back().continues, top);
+            patchJumps(loops.back().breaks, chunk->code.size());
+            loops.pop_back();
+            break;
+        }
+        case NODE_FOR_RANGE:
+        {
+            // the counter lives in hidden slots, one instruction steps and tests it at the end of every run of the body
+            ForRangeNode *forNode = static_cast<ForRangeNode *>(node);
+            compileExpression(forNode->getStart());
+            compileExpression(forNode->getStop());
+            if (forNode->getStep() != nullptr)
+            {
+                compileExpression(forNode->getStep());
+            }
+            else
+            {
+                emit(OP_CONST, 1);
+            }
+            int range = (int)chunk->ranges.size();
+            chunk->ranges.push_back(RangeLoop{rangeSlots(forNode), 0, 0});
+            emit(OP_FOR_START, range);
+            chunk->ranges[range].body = chunk->code.size();
+            loops.push_back(LoopJumps());
+            compileBlock(forNode->getBody());
+            patchJumps(loops.back().continues, chunk->code.size());
+            emit(OP_FOR_NEXT, range);
+            chunk->ranges[range].exit = chunk->code.size();
+            patchJumps(loops.back().breaks, chunk->code.size());
+            loops.pop_back();
+            break;
+        }
+        case NODE_BREAK:
+            loops.back().breaks.push_back(emit(OP_JUMP, 0));
+            break;
+        case NODE_CONTINUE:
+            loops.back().continues.push_back(emit(OP_JUMP, 0));
+            break;
+        case NODE_FUNC_DEF:
+            chunk->functions.push_back(static_cast<FuncDefNode *>(node));
+            emit(OP_DEF, (int)chunk->functions.size() - 1);
+            break;
+        case NODE_ASSIGNMENT:
+        {
+            AssignmentNode *assignmentNode = static_cast<AssignmentNode *>(node);
+            if (!compileIncrement(assignmentNode))
+            {
+                compileExpression(assignmentNode->expression);
+                emitStore(assignmentNode->variable->slot, assignmentNode->variable->local);
+            }
+            break;
+        }
+        case NODE_PRINT:
+        {
+            const ArenaArray<Node *> &arguments = static_cast<PrintNode *>(node)->getArguments();
+            for (size_t i = 0; i < arguments.size(); ++i)
+            {
+                if (arguments[i]->kind == NODE_STRING)
+                {
+                    chunk->strings.push_back(static_cast<StringNode *>(arguments[i])->getValue());
+                    emit(OP_PRINT_STRING, (int)chunk->strings.size() - 1);
+                }
+                else
+                {
+                    compileExpression(arguments[i]);
+                    emit(OP_PRINT_VALUE, 0);
+                }
+                if (i < arguments.size() - 1)
+                    emit(OP_PRINT_SPACE, 0);
+            }
+            emit(OP_PRINT_NEWLINE, 0);
+            break;
+        }
+        case NODE_FLUSH:
+            emit(OP_FLUSH, 0);
+            break;
+        case NODE_RETURN:
+        {
+            returnNode *return_node = static_cast<returnNode *>(node);
+            if (return_node->getValue() != nullptr)
+            {
+                compileExpression(return_node->getValue());
+            }
+            else
+            {
+                emit(OP_CONST, 0);
+            }
+            emit(OP_RETURN, 0);
+            break;
+        }
+        default:
+            compileExpression(node);
+            emit(OP_POP, 0);
+            break;
+        }
+    }
+
+    void compileExpression(Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_NUMBER:
+            emit(OP_CONST, static_cast<NumberNode *>(node)->value);
+            break;
+        case NODE_IDENTIFIER:
+            emitLoad(static_cast<IdentifierNode *>(node)->slot, static_cast<IdentifierNode *>(node)->local);
+            break;
+        case NODE_BINOP:
+        {
+            BinOpNode *binOpNode = static_cast<BinOpNode *>(node);
+            int leftSlot, rightSlot;
+            bool leftLocal, rightLocal;
+            if (superinstructions && binOpNode->op == PLUS && readsVariable(binOpNode->leftNode, leftSlot, leftLocal) &&
+                readsVariable(binOpNode->rightNode, rightSlot, rightLocal) && leftLocal == rightLocal)
+            {
+                emit(leftLocal ? OP_ADD_LOCALS : OP_ADD_GLOBALS, leftSlot, rightSlot);
+                break;
+            }
+            compileExpression(binOpNode->leftNode);
+            compileExpression(binOpNode->rightNode);
+            switch (binOpNode->op)
+            {
+            case PLUS:
+                emit(OP_ADD, 0);
+                break;
+            case MINUS:
+                emit(OP_SUB, 0);
+                break;
+            case MULTIPLY:
+                emit(OP_MUL, 0);
+                break;
+            case DIVIDE:
+                emit(OP_DIV, 0);
+                break;
+            case DOUBLE_EQUAL:
+                emit(OP_EQ, 0);
+                break;
+            case LESS_THAN:
+                emit(OP_LT, 0);
+                break;
+            case LESS_THAN_OR_EQUAL_TO:
+                emit(OP_LE, 0);
+                break;
+            case GREATER_THAN:
+                emit(OP_GT, 0);
+                break;
+            case GREATER_THAN_OR_EQUAL_TO:
+                emit(OP_GE, 0);
+                break;
+            default:
+                cerr << "Error: Unknown operator" << endl;
+                exit(1);
+            }
+            break;
+        }
+        case NODE_ASSIGNMENT:
+        {
+            AssignmentNode *assignmentNode = static_cast<AssignmentNode *>(node);
+            compileExpression(assignmentNode->expression);
+            emit(OP_DUP, 0);
+            emitStore(assignmentNode->variable->slot, assignmentNode->variable->local);
+            break;
+        }
+        case NODE_FUNC_CALL:
+        {
+            // the arguments are left on the stack in order, the call replaces them with its value
+            func_call *call = static_cast<func_call *>(node);
+            for (Node *argument : call->get_arguments())
+            {
+                compileExpression(argument);
+            }
+            depth -= (int)call->get_arguments().size();
+            chunk->calls.push_back(call);
+            emit(OP_CALL, (int)chunk->calls.size() - 1);
+            break;
+        }
+        default:
+            cerr << "Error: Unexpected node" << endl;
+            exit(1);
+        }
+    }
+};
+
+bool BytecodeCompiler::superinstructions = true;
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  CLOSURE COMPILER
+//////////////////////////////////////////////////////////////////////////////////
+// the third engine turns every node into a small object that holds a pointer to the function that runs it
+// and everything that function needs, so running the program never looks at a node kind again
+// binary operators are instantiated for each operator and each shape of operand (constant, local slot,
+// global slot, any other expression), so x + 1 becomes one function that reads slot x and adds 1
+struct ClosureContext;
+
+// runs what a call site names and what a def declares, implemented by the executor
+class ClosureRuntime
+{
+public:
+    virtual ~ClosureRuntime() {}
+    // the count values on top of context.arguments are the arguments, they are popped before the body runs
+    virtual int callFunction(func_call *call, ClosureContext &context, size_t count) = 0;
+    virtual void defineFunction(FuncDefNode *funcDef) = 0;
+};
+
+struct ClosureContext
+{
+    SymbolTable &symbolTable;
+    ClosureRuntime &runtime;
+    vector<int> arguments; // argument values of the calls being set up
+    int returnValue;
+
+    ClosureContext(SymbolTable &symbolTable, ClosureRuntime &runtime)
+        : symbolTable(symbolTable), runtime(runtime), returnValue(0) {}
+};
+
+struct ClosureExpr
+{
+    typedef int (*Run)(const ClosureExpr *self, ClosureContext &context);
+    Run run;
+
+    explicit ClosureExpr(Run run) : run(run) {}
+};
+
+// how a statement leaves: on to the next one, or out of the loop or function it is in
+enum Flow
+{
+    FLOW_NEXT,
+    FLOW_BREAK,
+    FLOW_CONTINUE,
+    FLOW_RETURN
+};
+
+struct ClosureStatement
+{
+    typedef Flow (*Run)(const ClosureStatement *self, ClosureContext &context);
+    Run run;
+
+    explicit ClosureStatement(Run run) : run(run) {}
+};
+
+typedef ArenaArray<const ClosureStatement *> ClosureBlock;
+
+static Flow runClosureBlock(const ClosureBlock &block, ClosureContext &context)
+{
+    for (const ClosureStatement *statement : block)
+    {
+        Flow flow = statement->run(statement, context);
+        if (flow != FLOW_NEXT)
+        {
+            return flow;
+        }
+    }
+    return FLOW_NEXT;
+}
+
+// the operands an operator can be specialized for, the slot or the constant is part of the closure
+struct ConstOperand
+{
+    int value;
+    int get(ClosureContext &) const
+    {
+        return value;
+    }
+};
+struct LocalOperand
+{
+    int slot;
+    int get(ClosureContext &context) const
+    {
+        return context.symbolTable.getLocal(slot);
+    }
+    void set(ClosureContext &context, int value) const
+    {
+        context.symbolTable.setLocal(slot, value);
+    }
+};
+struct GlobalOperand
+{
+    int slot;
+    int get(ClosureContext &context) const
+    {
+        return context.symbolTable.getGlobal(slot);
+    }
+    void set(ClosureContext &context, int value) const
+    {
+        context.symbolTable.setGlobal(slot, value);
+    }
+};
+struct ExprOperand
+{
+    const ClosureExpr *expr;
+    int get(ClosureContext &context) const
+    {
+        return expr->run(expr, context);
+    }
+};
+
+// the same operators as Interpreter::binaryOperation, with the operator fixed at compile time
+template <TokenType Op>
+static inline int applyOperator(int left, int right)
+{
+    if constexpr (Op == PLUS)
+        return wrappingAdd(left, right);
+    else if constexpr (Op == MINUS)
+        return wrappingSub(left, right);
+    else if constexpr (Op == MULTIPLY)
+        return wrappingMul(left, right);
+    else if constexpr (Op == DIVIDE)
+    {
+        if (right == 0)
+        {
+            cerr << "Error: Division by zero" << endl;
+            exit(1);
+        }
+        if (right == -1 && left == INT_MIN)
+        {
+            cerr << "Error: Integer overflow in division" << endl;
+            exit(1);
+        }
+        return left / right;
+    }
+    else if constexpr (Op == DOUBLE_EQUAL)
+        return left == right;
+    else if constexpr (Op == LESS_THAN)
+        return left < right;
+    else if constexpr (Op == LESS_THAN_OR_EQUAL_TO)
+        return left <= right;
+    else if constexpr (Op == GREATER_THAN)
+        return left > right;
+    else
+        return left >= right;
+}
+
+// an operand on its own: a constant, a variable or the value of a subexpression
+template <typename Operand>
+struct OperandClosure : ClosureExpr
+{
+    Operand operand;
+
+    OperandClosure(Operand operand) : ClosureExpr(&evaluate), operand(operand) {}
+
+    static int evaluate(const ClosureExpr *self, ClosureContext &context)
+    {
+        return static_cast<const OperandClosure *>(self)->operand.get(context);
+    }
+};
+
+template <TokenType Op, typename Left, typename Right>
+struct BinOpClosure : ClosureExpr
+{
+    Left left;
+    Right right;
+
+    BinOpClosure(Left left, Right right) : ClosureExpr(&evaluate), left(left), right(right) {}
+
+    static int evaluate(const ClosureExpr *self, ClosureContext &context)
+    {
+        const BinOpClosure *closure = static_cast<const BinOpClosure *>(self);
+        int leftValue = closure->left.get(context);
+        return applyOperator<Op>(leftValue, closure->right.get(context));
+    }
+};
+
+struct CallClosure : ClosureExpr
+{
+    func_call *call; // keeps the inline cache of the call site
+    ArenaArray<const ClosureExpr *> arguments;
+
+    CallClosure(func_call *call, ArenaArray<const ClosureExpr *> arguments)
+        : ClosureExpr(&evaluate), call(call), arguments(arguments) {}
+
+    static int evaluate(const ClosureExpr *self, ClosureContext &context)
+    {
+        const CallClosure *closure = static_cast<const CallClosure *>(self);
+        for (const ClosureExpr *argument : closure->arguments)
+        {
+            int value = argument->run(argument, context);
+            context.arguments.push_back(value);
+        }
+        return context.runtime.callFunction(closure->call, context, closure->arguments.size());
+    }
+};
+
+template <typename Target>
+struct AssignClosure : ClosureStatement
+{
+    Target target;
+    const ClosureExpr *value;
+
+    AssignClosure(Target target, const ClosureExpr *value) : ClosureStatement(&execute), target(target), value(value) {}
+
+    static Flow execute(const ClosureStatement *self, ClosureContext &context)
+    {
+        const AssignClosure *closure = static_cast<const AssignClosure *>(self);
+        closure->target.set(context, closure->value->run(closure->value, context));
+        return FLOW_NEXT;
+    }
+};
+
+// an expression whose value is dropped, a call statement
+struct ExprStatementClosure : ClosureStatement
+{
+    const ClosureExpr *value;
+
+    ExprStatementClosure(const ClosureExpr *value) : ClosureStatement(&execute), value(value) {}
+
+    static Flow execute(const ClosureStatement *self, ClosureContext &context)
+    {
+        const ClosureExpr *value = static_cast<const ExprStatementClosure *>(self)->value;
+        value->run(value, context);
+        return FLOW_NEXT;
+    }
+};
+
+// one print argument, a string when value is null
+struct PrintItem
+{
+    const ClosureExpr *value;
+    string_view text; // view into the StringNode, which lives as long as the closures of its unit
+};
+
+struct PrintClosure : ClosureStatement
+{
+    ArenaArray<PrintItem> items;
+
+    PrintClosure(ArenaArray<PrintItem> items) : ClosureStatement(&execute), items(items) {}
+
+    static Flow execute(const ClosureStatement *self, ClosureContext &context)
+    {
+        const ArenaArray<PrintItem> &items = static_cast<const PrintClosure *>(self)->items;
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            if (items[i].value == nullptr)
+            {
+                output.writeString(items[i].text);
+            }
+            else
+            {
+                output.writeInt(items[i].value->run(items[i].value, context));
+            }
+            if (i + 1 < items.size())
+            {
+                output.writeChar(' ');
+            }
+        }
+        output.endLine();
+        return FLOW_NEXT;
+    }
+};
+
+struct FlushClosure : ClosureStatement
+{
+    FlushClosure() : ClosureStatement(&execute) {}
+
+    static Flow execute(const ClosureStatement *, ClosureContext &)
+    {
+        output.flush();
+        return FLOW_NEXT;
+    }
+};
+
+// break and continue only leave with their flow, the loop that runs the block acts on it
+template <Flow Result>
+struct JumpClosure : ClosureStatement
+{
+    JumpClosure() : ClosureStatement(&execute) {}
+
+    static Flow execute(const ClosureStatement *, ClosureContext &)
+    {
+        return Result;
+    }
+};
+
+struct ReturnClosure : ClosureStatement
+{
+    const ClosureExpr *value; // null for a bare return
+
+    ReturnClosure(const ClosureExpr *value) : ClosureStatement(&execute), value(value) {}
+
+    static Flow execute(const ClosureStatement *self, ClosureContext &context)
+    {
+        const ClosureExpr *value = static_cast<const ReturnClosure *>(self)->value;
+        context.returnValue = value != nullptr ? value->run(value, context) : 0;
+        return FLOW_RETURN;
+    }
+};
+
+struct IfClosure : ClosureStatement
+{
+    const ClosureExpr *condition;
+    ClosureBlock thenBlock;
+    ClosureBlock elseBlock; // empty when there is no else
+
+    IfClosure(const ClosureExpr *condition, ClosureBlock thenBlock, ClosureBlock elseBlock)
+        : ClosureStatement(&execute), condition(condition), thenBlock(thenBlock), elseBlock(elseBlock) {}
+
+    static Flow execute(const ClosureStatement *self, ClosureContext &context)
+    {
+        const IfClosure *closure = static_cast<const IfClosure *>(self);
+        if (closure->condition->run(closure->condition, context))
+        {
+            return runClosureBlock(closure->thenBlock, context);
+        }
+        return runClosureBlock(closure->elseBlock, context);
+    }
+};
+
+struct WhileClosure : ClosureStatement
+{
+    const ClosureExpr *condition;
+    ClosureBlock body;
+
+    WhileClosure(const ClosureExpr *condition, ClosureBlock body) : ClosureStatement(&execute), condition(condition), body(body) {}
+
+    static Flow execute(const ClosureStatement *self, ClosureContext &context)
+    {
+        const WhileClosure *closure = static_cast<const WhileClosure *>(self);
+        while (closure->condition->run(closure->condition, context))
+        {
+            Flow flow = runClosureBlock(closure->body, context);
+            if (flow == FLOW_BREAK)
+            {
+                break;
+            }
+            if (flow == FLOW_RETURN)
+            {
+                return flow;
+            }
+        }
+        return FLOW_NEXT;
+    }
+};
+
+// the counter, stop and step stay in C++ locals, only the loop variable is written to its slot
+template <typename Variable>
+struct ForRangeClosure : ClosureStatement
+{
+    Variable variable;
+    const ClosureExpr *start;
+    const ClosureExpr *stop;
+    const ClosureExpr *step; // null when range() is given no step
+    ClosureBlock body;
+
+    ForRangeClosure(Variable variable, const ClosureExpr *start, const ClosureExpr *stop, const ClosureExpr *step, ClosureBlock body)
+        : ClosureStatement(&execute), variable(variable), start(start), stop(stop), step(step), body(body) {}
+
+    static Flow execute(const ClosureStatement *self, ClosureContext &context)
+    {
+        const ForRangeClosure *closure = static_cast<const ForRangeClosure *>(self);
+        int start = closure->start->run(closure->start, context);
+        int stop = closure->stop->run(closure->stop, context);
+        int step = closure->step != nullptr ? closure->step->run(closure->step, context) : 1;
+        if (step == 0)
+        {
+            cerr << "Error: range() step must not be zero" << endl;
+            exit(1);
+        }
+        // taken in 64 bits so a counter close to the int limits cannot wrap around
+        for (long long counter = start; step > 0 ? counter < stop : counter > stop; counter += step)
+        {
+            closure->variable.set(context, (int)counter);
+            Flow flow = runClosureBlock(closure->body, context);
+            if (flow == FLOW_BREAK)
+            {
+                break;
+            }
+            if (flow == FLOW_RETURN)
+            {
+                return flow;
+            }
+        }
+        return FLOW_NEXT;
+    }
+};
+
+struct DefClosure : ClosureStatement
+{
+    FuncDefNode *funcDef;
+
+    DefClosure(FuncDefNode *funcDef) : ClosureStatement(&execute), funcDef(funcDef) {}
+
+    static Flow execute(const ClosureStatement *self, ClosureContext &context)
+    {
+        context.runtime.defineFunction(static_cast<const DefClosure *>(self)->funcDef);
+        return FLOW_NEXT;
+    }
+};
+
+// builds the closures of a resolved block in the arena of its unit, the nodes stay owned by the block
+class ClosureCompiler
+{
+private:
+    Arena &arena;
+
+    ClosureCompiler(Arena &arena) : arena(arena) {}
+
+public:
+    static ClosureBlock compile(const BlockNode *block, Arena &arena)
+    {
+        ClosureCompiler compiler(arena);
+        return compiler.compileBlock(block);
+    }
+
+private:
+    ClosureBlock compileBlock(const BlockNode *block)
+    {
+        vector<const ClosureStatement *> statements;
+        if (block != nullptr)
+        {
+            for (Node *statement : block->getStatements())
+            {
+                statements.push_back(compileStatement(statement));
+            }
+        }
+        return arena.makeArray(statements);
+    }
+
+    // a variable is written through its slot, local or global decides the closure type
+    template <template <typename> class Closure, typename... Args>
+    const ClosureStatement *withTarget(const IdentifierNode *variable, Args... args)
+    {
+        if (variable->local)
+        {
+            return arena.make<Closure<LocalOperand>>(LocalOperand{variable->slot}, args...);
+        }
+        return arena.make<Closure<GlobalOperand>>(GlobalOperand{variable->slot}, args...);
+    }
+
+    const ClosureStatement *compileStatement(Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_ASSIGNMENT:
+        {
+            AssignmentNode *assignmentNode = static_cast<AssignmentNode *>(node);
+            return withTarget<AssignClosure>(assignmentNode->variable, compileExpression(assignmentNode->expression));
+        }
+        case NODE_PRINT:
+        {
+            vector<PrintItem> items;
+            for (Node *argument : static_cast<PrintNode *>(node)->getArguments())
+            {
+                if (argument->kind == NODE_STRING)
+                {
+                    items.push_back(PrintItem{nullptr, static_cast<StringNode *>(argument)->getValue()});
+                }
+                else
+                {
+                    items.push_back(PrintItem{compileExpression(argument), string_view()});
+                }
+            }
+            return arena.make<PrintClosure>(arena.makeArray(items));
+        }
+        case NODE_FLUSH:
+            return arena.make<FlushClosure>();
+        case NODE_BREAK:
+            return arena.make<JumpClosure<FLOW_BREAK>>();
+        case NODE_CONTINUE:
+            return arena.make<JumpClosure<FLOW_CONTINUE>>();
+        case NODE_RETURN:
+        {
+            Node *value = static_cast<returnNode *>(node)->getValue();
+            return arena.make<ReturnClosure>(value != nullptr ? compileExpression(value) : nullptr);
+        }
+        case NODE_IF:
+        {
+            IfNode *ifNode = static_cast<IfNode *>(node);
+            return arena.make<IfClosure>(compileExpression(ifNode->getCondition()), compileBlock(ifNode->getThenBlock()),
+                                         compileBlock(ifNode->getElseBlock()));
+        }
+        case NODE_WHILE:
+        {
+            WhileNode *whileNode = static_cast<WhileNode *>(node);
+            return arena.make<WhileClosure>(compileExpression(whileNode->getCondition()), compileBlock(whileNode->getBody()));
+        }
+        case NODE_FOR_RANGE:
+        {
+            ForRangeNode *forNode = static_cast<ForRangeNode *>(node);
+            const ClosureExpr *step = forNode->getStep() != nullptr ? compileExpression(forNode->getStep()) : nullptr;
+            return withTarget<ForRangeClosure>(forNode->getVariable(), compileExpression(forNode->getStart()),
+                                               compileExpression(forNode->getStop()), step, compileBlock(forNode->getBody()));
+        }
+        case NODE_FUNC_DEF:
+            return arena.make<DefClosure>(static_cast<FuncDefNode *>(node));
+        default:
+            return arena.make<ExprStatementClosure>(compileExpression(node));
+        }
+    }
+
+    ArenaArray<const ClosureExpr *> compileExpressions(const ArenaArray<Node *> &nodes)
+    {
+        vector<const ClosureExpr *> closures;
+        for (Node *node : nodes)
+        {
+            closures.push_back(compileExpression(node));
+        }
+        return arena.makeArray(closures);
+    }
+
+    const ClosureExpr *compileExpression(Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_NUMBER:
+            return arena.make<OperandClosure<ConstOperand>>(ConstOperand{static_cast<NumberNode *>(node)->value});
+        case NODE_IDENTIFIER:
+        {
+            const IdentifierNode *identifier = static_cast<const IdentifierNode *>(node);
+            if (identifier->local)
+            {
+                return arena.make<OperandClosure<LocalOperand>>(LocalOperand{identifier->slot});
+            }
+            return arena.make<OperandClosure<GlobalOperand>>(GlobalOperand{identifier->slot});
+        }
+        case NODE_BINOP:
+        {
+            BinOpNode *binOpNode = static_cast<BinOpNode *>(node);
+            switch (binOpNode->op)
+            {
+            case PLUS:
+                return binOp<PLUS>(binOpNode);
+            case MINUS:
+                return binOp<MINUS>(binOpNode);
+            case MULTIPLY:
+                return binOp<MULTIPLY>(binOpNode);
+            case DIVIDE:
+                return binOp<DIVIDE>(binOpNode);
+            case DOUBLE_EQUAL:
+                return binOp<DOUBLE_EQUAL>(binOpNode);
+            case LESS_THAN:
+                return binOp<LESS_THAN>(binOpNode);
+            case LESS_THAN_OR_EQUAL_TO:
+                return binOp<LESS_THAN_OR_EQUAL_TO>(binOpNode);
+            case GREATER_THAN:
+                return binOp<GREATER_THAN>(binOpNode);
+            case GREATER_THAN_OR_EQUAL_TO:
+                return binOp<GREATER_THAN_OR_EQUAL_TO>(binOpNode);
+            default:
+                cerr << "Error: Unknown operator" << endl;
+                exit(1);
+            }
+        }
+        case NODE_FUNC_CALL:
+        {
+            func_call *call = static_cast<func_call *>(node);
+            return arena.make<CallClosure>(call, compileExpressions(call->get_arguments()));
+        }
+        default:
+            cerr << "Error: Unexpected node" << endl;
+            exit(1);
+        }
+    }
+
+    // pick the operand shape of the left side, then of the right side, the pair selects the closure type
+    template <TokenType Op>
+    const ClosureExpr *binOp(BinOpNode *node)
+    {
+        Node *left = node->leftNode;
+        switch (left->kind)
+        {
+        case NODE_NUMBER:
+            return binOpRight<Op>(ConstOperand{static_cast<NumberNode *>(left)->value}, node->rightNode);
+        case NODE_IDENTIFIER:
+        {
+            const IdentifierNode *identifier = static_cast<const IdentifierNode *>(left);
+            if (identifier->local)
+            {
+                return binOpRight<Op>(LocalOperand{identifier->slot}, node->rightNode);
+            }
+            return binOpRight<Op>(GlobalOperand{identifier->slot}, node->rightNode);
+        }
+        default:
+            return binOpRight<Op>(ExprOperand{compileExpression(left)}, node->rightNode);
+        }
+    }
+
+    template <TokenType Op, typename Left>
+    const ClosureExpr *binOpRight(Left left, Node *right)
+    {
+        switch (right->kind)
+        {
+        case NODE_NUMBER:
+            return arena.make<BinOpClosure<Op, Left, ConstOperand>>(left, ConstOperand{static_cast<NumberNode *>(right)->value});
+        case NODE_IDENTIFIER:
+        {
+            const IdentifierNode *identifier = static_cast<const IdentifierNode *>(right);
+            if (identifier->local)
+            {
+                return arena.make<BinOpClosure<Op, Left, LocalOperand>>(left, LocalOperand{identifier->slot});
+            }
+            return arena.make<BinOpClosure<Op, Left, GlobalOperand>>(left, GlobalOperand{identifier->slot});
+        }
+        default:
+            return arena.make<BinOpClosure<Op, Left, ExprOperand>>(left, ExprOperand{compileExpression(right)});
+        }
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  JIT
+//////////////////////////////////////////////////////////////////////////////////
+// baseline compiler from the resolved tree of a function body to x86-64 machine code, used by the VM
+// once a function is hot (--jit=on) or from its first call (--jit=always)
+// only bodies without side effects of their own are compiled: locals, integer arithmetic, comparisons,
+// if, while, for range, return, calls and reads of globals; print, flush, def and anything else stay interpreted
+// the first locals live in callee saved registers, the others in the native frame, rbx holds the executor
+// calls and global reads go through the executor, so depth limits and call site caches work as in the VM
+#if defined(__x86_64__)
+#define HAVE_JIT 1
+#else
+#define HAVE_JIT 0
+#endif
+
+enum JitMode
+{
+    JIT_OFF,
+    JIT_ON,
+    JIT_ALWAYS
+};
+
+static constexpr size_t JIT_THRESHOLD = 100;  // calls before --jit=on compiles a function
+static constexpr size_t JIT_MAX_ARGUMENTS = 16; // calls with more arguments are not compiled
+
+// the generated function: its arguments in slot order, the executor is passed back to the helpers
+typedef int (*JitFunction)(void *executor, const int *arguments);
+
+// entry points of the executor the generated code calls
+struct JitHelpers
+{
+    int (*call)(void *executor, func_call *call, const int64_t *arguments); // arguments pushed in order, the last on top
+    int (*readGlobal)(void *executor, int slot);
+};
+
+// executable copy of the code of one function
+struct NativeCode
+{
+    void *memory;
+    size_t size;
+    JitFunction entry;
+
+    ~NativeCode()
+    {
+        munmap(memory, size);
+    }
+};
+
+[[noreturn]] static void jitDivisionByZero()
+{
+    cerr << "Error: Division by zero" << endl;
+    exit(1);
+}
+
+[[noreturn]] static void jitDivisionOverflow()
+{
+    cerr << "Error: Integer overflow in division" << endl;
+    exit(1);
+}
+
+[[noreturn]] static void jitZeroStep()
+{
+    cerr << "Error: range() step must not be zero" << endl;
+    exit(1);
+}
+
+class JitCompiler
+{
+private:
+    enum Register
+    {
+        RAX = 0,
+        RCX = 1,
+        RDX = 2,
+        RBX = 3,
+        RSP = 4,
+        RBP = 5,
+        RSI = 6,
+        RDI = 7,
+        R12 = 12
+    };
+    // condition codes of jcc and setcc
+    enum Condition
+    {
+        CC_E = 0x4,
+        CC_NE = 0x5,
+        CC_L = 0xC,
+        CC_GE = 0xD,
+        CC_LE = 0xE,
+        CC_G = 0xF
+    };
+    static constexpr int REGISTER_SLOTS = 4; // r12 to r15
+
+    // a register or the memory at [rbp + offset]
+    struct Location
+    {
+        bool memory;
+        int reg;
+        int32_t offset;
+    };
+
+    struct LoopLabels
+    {
+        int continueLabel;
+        int breakLabel;
+    };
+
+    vector<uint8_t> code;
+    vector<int> labels;                     // position of each label, -1 until it is bound
+    vector<pair<size_t, int>> fixups;       // rel32 fields to point at a label
+    vector<LoopLabels> loops;
+    JitHelpers helpers;
+    int stackDepth; // 8 byte values pushed below the aligned frame, keeps calls 16 byte aligned
+    int returnLabel;
+    int divisionByZeroLabel;
+    int divisionOverflowLabel;
+    int zeroStepLabel;
+
+    JitCompiler(const JitHelpers &helpers) : helpers(helpers), stackDepth(0) {}
+
+public:
+    // false when the body uses something the compiler leaves to the interpreter
+    static bool supports(const BlockNode *block)
+    {
+        for (const Node *statement : block->getStatements())
+        {
+            if (!supportsStatement(statement))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // null when the body is not supported or the platform has no JIT
+    static NativeCode *compile(const BlockNode *block, size_t arity, int frameSize, const JitHelpers &helpers)
+    {
+        if (!HAVE_JIT || !supports(block))
+        {
+            return nullptr;
+        }
+        JitCompiler compiler(helpers);
+        compiler.compileFunction(block, arity, frameSize);
+        size_t size = (compiler.code.size() + 4095) & ~(size_t)4095;
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        memcpy(memory, compiler.code.data(), compiler.code.size());
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(memory, size);
+            return nullptr;
+        }
+        NativeCode *native = new NativeCode();
+        native->memory = memory;
+        native->size = size;
+        native->entry = reinterpret_cast<JitFunction>(memory);
+        return native;
+    }
+
+private:
+    static bool supportsBlock(const BlockNode *block)
+    {
+        return block == nullptr || supports(block);
+    }
+
+    static bool supportsStatement(const Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_ASSIGNMENT:
+        {
+            const AssignmentNode *assignmentNode = static_cast<const AssignmentNode *>(node);
+            return assignmentNode->variable->local && supportsExpression(assignmentNode->expression);
+        }
+        case NODE_IF:
+        {
+            const IfNode *ifNode = static_cast<const IfNode *>(node);
+            return supportsExpression(ifNode->getCondition()) && supportsBlock(ifNode->getThenBlock()) &&
+                   supportsBlock(ifNode->getElseBlock());
+        }
+        case NODE_WHILE:
+            return supportsExpression(static_cast<const WhileNode *>(node)->getCondition()) &&
+                   supportsBlock(static_cast<const WhileNode *>(node)->getBody());
+        case NODE_FOR_RANGE:
+        {
+            const ForRangeNode *forNode = static_cast<const ForRangeNode *>(node);
+            return forNode->getVariable()->local && forNode->hiddenLocal && supportsExpression(forNode->getStart()) &&
+                   supportsExpression(forNode->getStop()) &&
+                   (forNode->getStep() == nullptr || supportsExpression(forNode->getStep())) && supportsBlock(forNode->getBody());
+        }
+        case NODE_BREAK:
+        case NODE_CONTINUE:
+            return true;
+        case NODE_RETURN:
+        {
+            const Node *value = static_cast<const returnNode *>(node)->getValue();
+            return value == nullptr || supportsExpression(value);
+        }
+        case NODE_FUNC_CALL:
+            return supportsExpression(node);
+        default:
+            return false;
+        }
+    }
+
+    static bool supportsExpression(const Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_NUMBER:
+        case NODE_IDENTIFIER:
+            return true;
+        case NODE_BINOP:
+        {
+            const BinOpNode *binOpNode = static_cast<const BinOpNode *>(node);
+            return supportsExpression(binOpNode->leftNode) && supportsExpression(binOpNode->rightNode);
+        }
+        case NODE_FUNC_CALL:
+        {
+            const func_call *call = static_cast<const func_call *>(node);
+            if (call->get_arguments().size() > JIT_MAX_ARGUMENTS)
+            {
+                return false;
+            }
+            for (const Node *argument : call->get_arguments())
+            {
+                if (!supportsExpression(argument))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // ------------------------------------------------------------------ encoding
+
+    void byte(uint8_t value)
+    {
+        code.push_back(value);
+    }
+    void dword(int32_t value)
+    {
+        uint8_t bytes[4];
+        memcpy(bytes, &value, 4);
+        code.insert(code.end(), bytes, bytes + 4);
+    }
+    void qword(uint64_t value)
+    {
+        uint8_t bytes[8];
+        memcpy(bytes, &value, 8);
+        code.insert(code.end(), bytes, bytes + 8);
+    }
+
+    static Location reg(int r)
+    {
+        return Location{false, r, 0};
+    }
+    // slots 0 to 3 are in r12 to r15, the others below the saved registers
+    static Location slot(int index)
+    {
+        if (index < REGISTER_SLOTS)
+        {
+            return reg(R12 + index);
+        }
+        return Location{true, RBP, -48 - 8 * (index - REGISTER_SLOTS)};
+    }
+
+    // an instruction with a ModRM byte: reg is the register operand (or the opcode extension), rm the other one
+    // opcodes above 0xff are two bytes starting with 0x0f
+    void modrm(bool wide, uint16_t opcode, int r, Location rm)
+    {
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | ((r & 8) ? 4 : 0) | (!rm.memory && (rm.reg & 8) ? 1 : 0);
+        if (rex != 0x40)
+        {
+            byte(rex);
+        }
+        if (opcode > 0xff)
+        {
+            byte(opcode >> 8);
+        }
+        byte(opcode & 0xff);
+        if (rm.memory)
+        {
+            byte(0x80 | (r & 7) << 3 | (rm.reg & 7));
+            dword(rm.offset);
+        }
+        else
+        {
+            byte(0xc0 | (r & 7) << 3 | (rm.reg & 7));
+        }
+    }
+
+    void loadSlot(int r, int index) // mov r32, slot
+    {
+        modrm(false, 0x8b, r, slot(index));
+    }
+    void storeSlot(int index) // mov slot, eax
+    {
+        modrm(false, 0x89, RAX, slot(index));
+    }
+    void moveImmediate(int r, int32_t value) // mov r32, imm32
+    {
+        byte(0xb8 + r);
+        dword(value);
+    }
+    void push(int r)
+    {
+        byte(0x50 + r);
+        stackDepth++;
+    }
+    void pop(int r)
+    {
+        byte(0x58 + r);
+        stackDepth--;
+    }
+    void adjustStack(int32_t bytes) // add rsp, bytes
+    {
+        if (bytes != 0)
+        {
+            modrm(true, 0x81, 0, reg(RSP));
+            dword(bytes);
+        }
+    }
+
+    int newLabel()
+    {
+        labels.push_back(-1);
+        return (int)labels.size() - 1;
+    }
+    void bind(int label)
+    {
+        labels[label] = (int)code.size();
+    }
+    void jump(int label)
+    {
+        byte(0xe9);
+        fixups.push_back({code.size(), label});
+        dword(0);
+    }
+    void jumpIf(int condition, int label)
+    {
+        byte(0x0f);
+        byte(0x80 + condition);
+        fixups.push_back({code.size(), label});
+        dword(0);
+    }
+
+    // call a function at a fixed address, rsp is aligned to 16 bytes around it
+    void callAddress(const void *address)
+    {
+        bool pad = stackDepth % 2 != 0;
+        if (pad)
+        {
+            adjustStack(-8);
+        }
+        byte(0x48); // mov rax, imm64
+        byte(0xb8);
+        qword(reinterpret_cast<uint64_t>(address));
+        byte(0xff); // call rax
+        byte(0xd0);
+        if (pad)
+        {
+            adjustStack(8);
+        }
+    }
+
+    // ------------------------------------------------------------------ code generation
+
+    void compileFunction(const BlockNode *block, size_t arity, int frameSize)
+    {
+        returnLabel = newLabel();
+        divisionByZeroLabel = newLabel();
+        divisionOverflowLabel = newLabel();
+        zeroStepLabel = newLabel();
+
+        // push rbp, mov rbp, rsp, save rbx and r12 to r15, rsp is then 8 bytes off a 16 byte boundary
+        byte(0x55);
+        modrm(true, 0x89, RSP, reg(RBP));
+        byte(0x53);
+        for (int r = R12; r < R12 + REGISTER_SLOTS; r++)
+        {
+            byte(0x41);
+            byte(0x50 + (r & 7));
+        }
+        int spilled = max(0, frameSize - REGISTER_SLOTS);
+        adjustStack(-8 * (spilled + (spilled % 2 == 0 ? 1 : 0)));
+        modrm(true, 0x89, RDI, reg(RBX)); // mov rbx, rdi
+
+        // the arguments are the first slots, the other locals start at 0 like an interpreted frame
+        for (int i = 0; i < frameSize; i++)
+        {
+            if ((size_t)i < arity)
+            {
+                modrm(false, 0x8b, RAX, Location{true, RSI, 4 * i}); // mov eax, [rsi + 4 * i]
+            }
+            else
+            {
+                modrm(false, 0x31, RAX, reg(RAX)); // xor eax, eax
+            }
+            storeSlot(i);
+        }
+
+        compileBlock(block);
+        modrm(false, 0x31, RAX, reg(RAX)); // a body that runs off its end returns 0
+
+        bind(returnLabel);
+        byte(0x48); // lea rsp, [rbp - 40]
+        byte(0x8d);
+        byte(0x65);
+        byte(0xd8);
+        for (int r = R12 + REGISTER_SLOTS - 1; r >= R12; r--)
+        {
+            byte(0x41);
+            byte(0x58 + (r & 7));
+        }
+        byte(0x5b);
+        byte(0x5d);
+        byte(0xc3);
+
+        // error exits, the stack is aligned before the call since they print
+        bind(divisionByZeroLabel);
+        modrm(true, 0x83, 4, reg(RSP)); // and rsp, -16
+        byte(0xf0);
+        stackDepth = 0;
+        callAddress(reinterpret_cast<const void *>(&jitDivisionByZero));
+        bind(divisionOverflowLabel);
+        modrm(true, 0x83, 4, reg(RSP));
+        byte(0xf0);
+        callAddress(reinterpret_cast<const void *>(&jitDivisionOverflow));
+        bind(zeroStepLabel);
+        modrm(true, 0x83, 4, reg(RSP));
+        byte(0xf0);
+        callAddress(reinterpret_cast<const void *>(&jitZeroStep));
+
+        for (const pair<size_t, int> &fixup : fixups)
+        {
+            int32_t relative = labels[fixup.second] - (int32_t)(fixup.first + 4);
+            memcpy(code.data() + fixup.first, &relative, 4);
+        }
+    }
+
+    void compileBlock(const BlockNode *block)
+    {
+        for (const Node *statement : block->getStatements())
+        {
+            compileStatement(statement);
+        }
+    }
+
+    void compileStatement(const Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_ASSIGNMENT:
+        {
+            const AssignmentNode *assignmentNode = static_cast<const AssignmentNode *>(node);
+            compileExpression(assignmentNode->expression);
+            storeSlot(assignmentNode->variable->slot);
+            break;
+        }
+        case NODE_IF:
+        {
+            const IfNode *ifNode = static_cast<const IfNode *>(node);
+            int elseLabel = newLabel();
+            compileBranchIfFalse(ifNode->getCondition(), elseLabel);
+            compileBlock(ifNode->getThenBlock());
+            if (ifNode->getElseBlock() != nullptr)
+            {
+                int endLabel = newLabel();
+                jump(endLabel);
+                bind(elseLabel);
+                compileBlock(ifNode->getElseBlock());
+                bind(endLabel);
+            }
+            else
+            {
+                bind(elseLabel);
+            }
+            break;
+        }
+        case NODE_WHILE:
+        {
+            const WhileNode *whileNode = static_cast<const WhileNode *>(node);
+            LoopLabels loop{newLabel(), newLabel()};
+            bind(loop.continueLabel);
+            compileBranchIfFalse(whileNode->getCondition(), loop.breakLabel);
+            loops.push_back(loop);
+            compileBlock(whileNode->getBody());
+            loops.pop_back();
+            jump(loop.continueLabel);
+            bind(loop.breakLabel);
+            break;
+        }
+        case NODE_FOR_RANGE:
+            compileForRange(static_cast<const ForRangeNode *>(node));
+            break;
+        case NODE_BREAK:
+            jump(loops.back().breakLabel);
+            break;
+        case NODE_CONTINUE:
+            jump(loops.back().continueLabel);
+            break;
+        case NODE_RETURN:
+        {
+            const Node *value = static_cast<const returnNode *>(node)->getValue();
+            if (value != nullptr)
+            {
+                compileExpression(value);
+            }
+            else
+            {
+                modrm(false, 0x31, RAX, reg(RAX));
+            }
+            jump(returnLabel);
+            break;
+        }
+        default:
+            compileExpression(node);
+            break;
+        }
+    }
+
+    // the counter, stop and step use the hidden slots like the interpreters, the step is added in 64 bits
+    void compileForRange(const ForRangeNode *forNode)
+    {
+        int variable = forNode->getVariable()->slot;
+        LoopLabels loop{newLabel(), newLabel()};
+        int body = newLabel();
+        int negative = newLabel();
+        int check = newLabel();
+
+        compileExpression(forNode->getStart());
+        storeSlot(forNode->counterSlot);
+        compileExpression(forNode->getStop());
+        storeSlot(forNode->stopSlot);
+        if (forNode->getStep() != nullptr)
+        {
+            compileExpression(forNode->getStep());
+        }
+        else
+        {
+            moveImmediate(RAX, 1);
+        }
+        storeSlot(forNode->stepSlot);
+        modrm(false, 0x89, RAX, reg(RCX)); // mov ecx, eax
+        modrm(false, 0x85, RCX, reg(RCX)); // test ecx, ecx
+        jumpIf(CC_E, zeroStepLabel);
+        // the first value is start itself, checked against stop like the following ones
+        modrm(true, 0x63, RAX, slot(forNode->counterSlot)); // movsxd rax, counter
+        jump(check);
+
+        bind(loop.continueLabel);
+        modrm(true, 0x63, RAX, slot(forNode->counterSlot)); // movsxd rax, counter
+        modrm(true, 0x63, RCX, slot(forNode->stepSlot));    // movsxd rcx, step
+        modrm(true, 0x01, RCX, reg(RAX));                   // add rax, rcx
+        bind(check);
+        modrm(false, 0x85, RCX, reg(RCX)); // test ecx, ecx
+        jumpIf(CC_L, negative);
+        // step > 0: leave once the counter reaches stop
+        modrm(true, 0x63, RDX, slot(forNode->stopSlot)); // movsxd rdx, stop
+        modrm(true, 0x39, RDX, reg(RAX));                // cmp rax, rdx
+        jumpIf(CC_GE, loop.breakLabel);
+        jump(body);
+        bind(negative);
+        modrm(true, 0x63, RDX, slot(forNode->stopSlot));
+        modrm(true, 0x39, RDX, reg(RAX));
+        jumpIf(CC_LE, loop.breakLabel);
+
+        bind(body);
+        storeSlot(forNode->counterSlot);
+        storeSlot(variable);
+        loops.push_back(loop);
+        compileBlock(forNode->getBody());
+        loops.pop_back();
+        jump(loop.continueLabel);
+        bind(loop.breakLabel);
+    }
+
+    static int comparison(TokenType op)
+    {
+        switch (op)
+        {
+        case DOUBLE_EQUAL:
+            return CC_E;
+        case LESS_THAN:
+            return CC_L;
+        case LESS_THAN_OR_EQUAL_TO:
+            return CC_LE;
+        case GREATER_THAN:
+            return CC_G;
+        case GREATER_THAN_OR_EQUAL_TO:
+            return CC_GE;
+        default:
+            return -1;
+        }
+    }
+
+    // a comparison jumps on the flags, anything else is tested for 0
+    void compileBranchIfFalse(const Node *condition, int label)
+    {
+        if (condition->kind == NODE_BINOP)
+        {
+            const BinOpNode *binOpNode = static_cast<const BinOpNode *>(condition);
+            int condition = comparison(binOpNode->op);
+            if (condition >= 0)
+            {
+                compileOperands(binOpNode);
+                modrm(false, 0x39, RCX, reg(RAX)); // cmp eax, ecx
+                jumpIf(condition ^ 1, label);      // the opposite condition
+                return;
+            }
+        }
+        compileExpression(condition);
+        modrm(false, 0x85, RAX, reg(RAX));
+        jumpIf(CC_E, label);
+    }
+
+    // left in eax and right in ecx, a constant or a local on the right is loaded straight into ecx
+    void compileOperands(const BinOpNode *binOpNode)
+    {
+        const Node *right = binOpNode->rightNode;
+        if (right->kind == NODE_NUMBER)
+        {
+            compileExpression(binOpNode->leftNode);
+            moveImmediate(RCX, static_cast<const NumberNode *>(right)->value);
+            return;
+        }
+        if (right->kind == NODE_IDENTIFIER && static_cast<const IdentifierNode *>(right)->local)
+        {
+            compileExpression(binOpNode->leftNode);
+            loadSlot(RCX, static_cast<const IdentifierNode *>(right)->slot);
+            return;
+        }
+        compileExpression(binOpNode->leftNode);
+        push(RAX);
+        compileExpression(right);
+        modrm(false, 0x89, RAX, reg(RCX)); // mov ecx, eax
+        pop(RAX);
+    }
+
+    // leaves the value in eax
+    void compileExpression(const Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_NUMBER:
+            moveImmediate(RAX, static_cast<const NumberNode *>(node)->value);
+            break;
+        case NODE_IDENTIFIER:
+        {
+            const IdentifierNode *identifier = static_cast<const IdentifierNode *>(node);
+            if (identifier->local)
+            {
+                loadSlot(RAX, identifier->slot);
+            }
+            else
+            {
+                modrm(true, 0x89, RBX, reg(RDI)); // mov rdi, rbx
+                moveImmediate(RSI, identifier->slot);
+                callAddress(reinterpret_cast<const void *>(helpers.readGlobal));
+            }
+            break;
+        }
+        case NODE_BINOP:
+        {
+            const BinOpNode *binOpNode = static_cast<const BinOpNode *>(node);
+            compileOperands(binOpNode);
+            switch (binOpNode->op)
+            {
+            case PLUS:
+                modrm(false, 0x01, RCX, reg(RAX)); // add eax, ecx
+                break;
+            case MINUS:
+                modrm(false, 0x29, RCX, reg(RAX)); // sub eax, ecx
+                break;
+            case MULTIPLY:
+                modrm(false, 0x0faf, RAX, reg(RCX)); // imul eax, ecx
+                break;
+            case DIVIDE:
+            {
+                // idiv traps on INT_MIN / -1, the interpreters report it as an error instead
+                int divide = newLabel();
+                modrm(false, 0x85, RCX, reg(RCX)); // test ecx, ecx
+                jumpIf(CC_E, divisionByZeroLabel);
+                modrm(false, 0x83, 7, reg(RCX)); // cmp ecx, -1
+                byte(0xff);
+                jumpIf(CC_NE, divide);
+                byte(0x3d); // cmp eax, INT_MIN
+                dword(INT_MIN);
+                jumpIf(CC_E, divisionOverflowLabel);
+                bind(divide);
+                byte(0x99);                      // cdq
+                modrm(false, 0xf7, 7, reg(RCX)); // idiv ecx
+                break;
+            }
+            default:
+                modrm(false, 0x39, RCX, reg(RAX));                         // cmp eax, ecx
+                modrm(false, 0x0f90 | comparison(binOpNode->op), 0, reg(RAX)); // setcc al
+                modrm(false, 0x0fb6, RAX, reg(RAX));                         // movzx eax, al
+                break;
+            }
+            break;
+        }
+        case NODE_FUNC_CALL:
+        {
+            // the arguments are pushed in order, the helper gets a pointer to the last one
+            const func_call *call = static_cast<const func_call *>(node);
+            for (const Node *argument : call->get_arguments())
+            {
+                compileExpression(argument);
+                push(RAX);
+            }
+            modrm(true, 0x89, RSP, reg(RDX)); // mov rdx, rsp
+            modrm(true, 0x89, RBX, reg(RDI)); // mov rdi, rbx
+            byte(0x48);                       // mov rsi, imm64
+            byte(0xbe);
+            qword(reinterpret_cast<uint64_t>(call));
+            callAddress(reinterpret_cast<const void *>(helpers.call));
+            adjustStack(8 * (int32_t)call->get_arguments().size());
+            stackDepth -= (int)call->get_arguments().size();
+            break;
+        }
+        default:
+            cerr << "Error: Unexpected node" << endl;
+            exit(1);
+        }
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  EXECUTOR
+//////////////////////////////////////////////////////////////////////////////////
+// the tree walker and the closure engine are kept next to the bytecode VM so they can be compared
+enum Engine
+{
+    ENGINE_AST,
+    ENGINE_VM,
+    ENGINE_CLOSURE
+};
+
+// what a def leaves behind: the arity, the body source and its compiled forms, built on the first call
+// the parameters are the first arity slots of the frame, so a call copies its arguments straight into them
+// the nodes of the body live in its own arena so the body is freed in one go once nothing runs it
+struct FunctionBody
+{
+    string source; // copied from the def, the tree that held the def can be freed before the body is compiled
+    vector<int> parameters; // interned names, in slot order
+    size_t arity;
+    Arena arena;
+    BlockNode *compiled;
+    FlatAst flat; // what the tree walker runs, built from compiled
+    Chunk *bytecode;
+    ClosureBlock *closures; // in the arena, null until the closure engine first calls the function
+    int frameSize; // locals of the body, known once it is resolved
+    NativeCode *native; // null until the VM finds the function hot and the JIT supports the body
+    size_t calls;       // calls counted towards the JIT threshold
+    bool jitSupported;  // false for bodies with side effects of their own, they always run in the VM
+
+    FunctionBody()
+        : arity(0), compiled(nullptr), bytecode(nullptr), closures(nullptr), frameSize(0), native(nullptr), calls(0),
+          jitSupported(false) {}
+    FunctionBody(const FunctionBody &) = delete;
+    FunctionBody &operator=(const FunctionBody &) = delete;
+    ~FunctionBody()
+    {
+        delete bytecode;
+        delete native;
+    }
+};
+
+// runs a compiled program with the selected engine, the function bodies are shared by both
+class Executor : public FunctionCaller, public ClosureRuntime
+{
+private:
+    SymbolTable &symbolTable;
+    Engine engine;
+    unordered_map<int, FunctionBody *> funcBlockMap; // keyed by the interned function name
+    // bodies a def rebound while a function was running, the running one may be among them
+    vector<FunctionBody *> retiredBodies;
+    size_t bodyCompiles;
+    size_t callCacheHits;
+    size_t callCacheMisses;
+    // bumped by every def and by every new executor, a call site cache filled in an older version is stale
+    static uint32_t defVersion;
+    // a block the tree walker is inside of, the one running is kept in locals and the outer ones here
+    // a block that is a function body remembers the caller's frame so return can unwind to it,
+    // and the caller's statement that takes the value when the call is the whole expression of one
+    // the body of a loop remembers the loop so it can run again, break and continue unwind to it
+    struct BlockRecord
+    {
+        const uint32_t *next; // next statement to run
+        const uint32_t *end;
+        const FlatAst *ast; // the program or the function body the statements belong to
+        bool body;
+        size_t callerBase;
+        uint32_t loop;
+        uint32_t pending; // assignment, return or call statement waiting for the value, NO_NODE for a nested call
+    };
+    vector<BlockRecord> blockStack;
+    vector<int> argumentStack; // argument values of the calls the tree walker is setting up
+    // where the VM continues when the running function returns
+    struct CallRecord
+    {
+        Chunk *chunk;
+        size_t pc;
+        size_t callerBase;
+    };
+    vector<CallRecord> callStack;
+    // values of every running chunk, the values of a call start where its caller's end
+    vector<int> vmStack;
+    ClosureContext closureContext;
+    // --stats runs the VM with counters of every instruction and every pair of consecutive instructions
+    bool profile;
+    vector<size_t> dispatchCounts;
+    vector<size_t> pairCounts;
+    // the closure engine recurses for every call, it stops before the C++ stack would run out
+    // and native code falls back to the VM near it
+    uintptr_t stackLimit;
+    // where a VM run started by native code may put its values, above those of the runs below it
+    size_t nativeTop;
+    size_t jitCompiles;
+    size_t nativeCalls;
+    size_t jitChecks;
+    size_t jitUnchecked;
+    // --jit-check runs the outermost native call again in the VM with the JIT suspended
+    bool checkActive;
+    bool impureSeen; // a body the JIT does not support ran during the native run of the check
+    bool jitSuspended;
+
+public:
+    Executor(SymbolTable &symbolTable, Engine engine)
+        : symbolTable(symbolTable), engine(engine), bodyCompiles(0), callCacheHits(0), callCacheMisses(0), vmStack(1024),
+          closureContext(symbolTable, *this), profile(false), stackLimit(0), nativeTop(0), jitCompiles(0), nativeCalls(0),
+          jitChecks(0), jitUnchecked(0), checkActive(false), impureSeen(false), jitSuspended(false)
+    {
+        defVersion++;
+        Interpreter::functionCaller = this;
+    }
+
+    ~Executor()
+    {
+        for (auto &pair : funcBlockMap)
+        {
+            delete pair.second;
+        }
+        freeRetired();
+    }
+
+    static bool threadedDispatch; // computed goto where available, --dispatch=switch turns it off
+    static JitMode jitMode;       // only the VM compiles functions to native code
+    static bool jitCheck;
+    static bool reloadTrees; // the AST engine runs a saved and loaded copy of every flat tree it builds
+
+    void setProfile(bool enabled)
+    {
+        profile = enabled;
+        dispatchCounts.assign(OP_COUNT, 0);
+        pairCounts.assign(OP_COUNT * OP_COUNT, 0);
+    }
+
+    size_t dispatched() const
+    {
+        size_t total = 0;
+        for (size_t count : dispatchCounts)
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    void printStats() const
+    {
+        cerr << "function bodies compiled: " << bodyCompiles << endl;
+        cerr << "call site cache hits: " << callCacheHits << ", misses: " << callCacheMisses << endl;
+        size_t used = 0;
+        size_t reserved = 0;
+        size_t flat = 0;
+        for (const auto &pair : funcBlockMap)
+        {
+            used += pair.second->arena.used();
+            reserved += pair.second->arena.reserved();
+            flat += pair.second->flat.bytes();
+        }
+        cerr << "function body arenas: " << used << " bytes used, " << reserved << " bytes reserved" << endl;
+        if (engine == ENGINE_AST)
+        {
+            cerr << "function body flat trees: " << flat << " bytes" << endl;
+        }
+        if (engine == ENGINE_VM && jitMode != JIT_OFF)
+        {
+            cerr << "jit: " << jitCompiles << " functions compiled, " << nativeCalls << " native calls" << endl;
+            if (jitCheck)
+            {
+                cerr << "jit check: " << jitChecks << " calls matched the VM, " << jitUnchecked
+                     << " skipped after running a body with side effects" << endl;
+            }
+        }
+        if (engine == ENGINE_VM && profile)
+        {
+            cerr << "instructions dispatched: " << dispatched() << endl;
+            // the pairs that run most often are the candidates for superinstructions
+            vector<size_t> pairs;
+            for (size_t pair = 0; pair < pairCounts.size(); pair++)
+            {
+                if (pairCounts[pair] > 0)
+                {
+                    pairs.push_back(pair);
+                }
+            }
+            sort(pairs.begin(), pairs.end(), [this](size_t a, size_t b)
+                 { return pairCounts[a] > pairCounts[b]; });
+            cerr << "most frequent instruction pairs:" << endl;
+            for (size_t i = 0; i < pairs.size() && i < 8; i++)
+            {
+                cerr << "  " << opNames[pairs[i] / OP_COUNT] << " " << opNames[pairs[i] % OP_COUNT] << ": "
+                     << pairCounts[pairs[i]] << endl;
+            }
+        }
+    }
+
+    void run(const BlockNode *program)
+    {
+        if (engine == ENGINE_AST)
+        {
+            setStackLimit();
+            FlatAst flat = buildFlat(program);
+            executeBlock(blockRecord(flat, flat.root, NO_NODE));
+        }
+        else if (engine == ENGINE_CLOSURE)
+        {
+            setStackLimit();
+            Arena arena;
+            runClosureBlock(ClosureCompiler::compile(program, arena), closureContext);
+        }
+        else
+        {
+            setStackLimit();
+            Chunk *chunk = BytecodeCompiler::compile(program, false);
+            executeChunk(chunk, 0);
+            delete chunk;
+        }
+    }
+
+    static FlatAst buildFlat(const BlockNode *block)
+    {
+        FlatAst flat = FlatAst::build(block);
+        if (!reloadTrees)
+        {
+            return flat;
+        }
+        FlatAst loaded = FlatAst::deserialize(flat.serialize());
+        if (!loaded.sameAs(flat))
+        {
+            cerr << "Error: the loaded flat tree does not match the one that was saved" << endl;
+            exit(1);
+        }
+        return loaded;
+    }
+
+    // a call inside a larger expression runs its body on the C++ stack, the executor loop runs
+    // the calls that are the whole expression of a statement without recursing
+    int callFunction(const FlatAst &ast, const FlatNode &call) override
+    {
+        checkStack();
+        return executeBlock(startCall(ast, call, NO_NODE));
+    }
+
+    // the closure engine runs every call on the C++ stack, the arguments were pushed by the call closure
+    int callFunction(func_call *call, ClosureContext &context, size_t count) override
+    {
+        checkStack();
+        size_t base = context.arguments.size() - count;
+        FunctionBody &body = callee(call, count);
+        size_t callerBase = symbolTable.pushFrame(body.frameSize, context.arguments.data() + base, count);
+        context.arguments.resize(base);
+        int value = runClosureBlock(*body.closures, context) == FLOW_RETURN ? context.returnValue : 0;
+        symbolTable.popFrame(callerBase);
+        return value;
+    }
+
+private:
+    void setStackLimit()
+    {
+        struct rlimit limit;
+        size_t stackSize = 8 * 1024 * 1024;
+        if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        {
+            stackSize = limit.rlim_cur;
+        }
+        // the stack grows down from here, the margin covers main and what reports the error
+        char here;
+        stackLimit = reinterpret_cast<uintptr_t>(&here) - (stackSize - 256 * 1024);
+    }
+
+    bool stackHasRoom() const
+    {
+        char here;
+        return reinterpret_cast<uintptr_t>(&here) >= stackLimit;
+    }
+
+    // the engines that call on the C++ stack stop with an error before it overflows
+    void checkStack() const
+    {
+        if (!stackHasRoom())
+        {
+            cerr << "Error: Maximum recursion depth exceeded, the C++ stack is exhausted" << endl;
+            exit(1);
+        }
+    }
+
+    static BlockRecord blockRecord(const FlatAst &ast, uint32_t block, uint32_t loop)
+    {
+        uint32_t list = ast.nodes[block].first;
+        return BlockRecord{ast.listBegin(list), ast.listEnd(list), &ast, false, 0, loop, NO_NODE};
+    }
+
+    // one loop runs every block at every call depth, entering a block or a call saves the current one
+    // instead of recursing, so deep call chains do not grow the C++ stack
+    // returns the value of the function when current is a function body
+    int executeBlock(BlockRecord current)
+    {
+        size_t entryDepth = blockStack.size();
+        while (true)
+        {
+            if (current.next == current.end)
+            {
+                // the body of a loop starts over while the loop goes on
+                if (current.loop != NO_NODE && loopAgain(*current.ast, current.loop))
+                {
+                    uint32_t body = loopBody(*current.ast, current.ast->nodes[current.loop]);
+                    current.next = current.ast->listBegin(current.ast->nodes[body].first);
+                    continue;
+                }
+                // a function body that runs off its end returns 0
+                if (current.body)
+                {
+                    if (finishCall(current, 0, entryDepth))
+                    {
+                        return 0;
+                    }
+                    continue;
+                }
+                if (blockStack.size() == entryDepth)
+                {
+                    return 0;
+                }
+                current = blockStack.back();
+                blockStack.pop_back();
+                continue;
+            }
+            const FlatAst &ast = *current.ast;
+            uint32_t index = *current.next++;
+            const FlatNode &statement = ast.nodes[index];
+            switch (statement.kind)
+            {
+            case NODE_IF:
+            {
+                uint32_t branch = (uint32_t)statement.value;
+                if (Interpreter::evaluate(ast, statement.first, symbolTable))
+                {
+                    branch = statement.second;
+                }
+                if (branch != NO_NODE)
+                {
+                    blockStack.push_back(current);
+                    current = blockRecord(ast, branch, NO_NODE);
+                }
+                break;
+            }
+            case NODE_WHILE:
+            case NODE_FOR_RANGE:
+                if (loopStart(ast, statement))
+                {
+                    blockStack.push_back(current);
+                    current = blockRecord(ast, loopBody(ast, statement), index);
+                }
+                break;
+            case NODE_BREAK:
+                // leave the innermost loop without testing it again
+                while (current.loop == NO_NODE)
+                {
+                    current = blockStack.back();
+                    blockStack.pop_back();
+                }
+                current = blockStack.back();
+                blockStack.pop_back();
+                break;
+            case NODE_CONTINUE:
+                // skip the rest of the body, the end of the body decides if the loop goes on
+                while (current.loop == NO_NODE)
+                {
+                    current = blockStack.back();
+                    blockStack.pop_back();
+                }
+                current.next = current.end;
+                break;
+            case NODE_FUNC_DEF:
+                defineFunction(ast, statement);
+                break;
+            case NODE_ASSIGNMENT:
+                if (ast.nodes[statement.first].kind == NODE_FUNC_CALL)
+                {
+                    enterCall(current, ast, ast.nodes[statement.first], index);
+                }
+                else
+                {
+                    Interpreter::evaluate(ast, index, symbolTable);
+                }
+                break;
+            case NODE_FUNC_CALL:
+                enterCall(current, ast, statement, index);
+                break;
+            case NODE_RETURN:
+            {
+                if (statement.first != NO_NODE && ast.nodes[statement.first].kind == NODE_FUNC_CALL)
+                {
+                    enterCall(current, ast, ast.nodes[statement.first], index);
+                    break;
+                }
+                int result = statement.first != NO_NODE ? Interpreter::evaluate(ast, statement.first, symbolTable) : 0;
+                if (finishCall(current, result, entryDepth))
+                {
+                    return result;
+                }
+                break;
+            }
+            default:
+                Interpreter::evaluate(ast, index, symbolTable);
+                break;
+            }
+        }
+    }
+
+    // evaluate the arguments, then start a frame for the body of the called function
+    BlockRecord startCall(const FlatAst &ast, const FlatNode &call, uint32_t pending)
+    {
+        size_t base = argumentStack.size();
+        for (const uint32_t *argument = ast.listBegin(call.first); argument != ast.listEnd(call.first); ++argument)
+        {
+            argumentStack.push_back(Interpreter::evaluate(ast, *argument, symbolTable));
+        }
+        FunctionBody &body = callee(ast, call, argumentStack.size() - base);
+        size_t callerBase = symbolTable.pushFrame(body.frameSize, argumentStack.data() + base, argumentStack.size() - base);
+        argumentStack.resize(base);
+        BlockRecord record = blockRecord(body.flat, body.flat.root, NO_NODE);
+        record.body = true;
+        record.callerBase = callerBase;
+        record.pending = pending;
+        return record;
+    }
+
+    void enterCall(BlockRecord &current, const FlatAst &ast, const FlatNode &call, uint32_t statement)
+    {
+        BlockRecord callee = startCall(ast, call, statement);
+        blockStack.push_back(current);
+        current = callee;
+    }
+
+    // leave the function body the running block is part of and hand value to the statement that made the call,
+    // a caller that was returning the call's value leaves its own body with it too
+    // true when the body left is the one executeBlock was started with
+    bool finishCall(BlockRecord &current, int value, size_t entryDepth)
+    {
+        while (true)
+        {
+            while (!current.body)
+            {
+                current = blockStack.back();
+                blockStack.pop_back();
+            }
+            symbolTable.popFrame(current.callerBase);
+            uint32_t pending = current.pending;
+            if (blockStack.size() == entryDepth)
+            {
+                return true;
+            }
+            current = blockStack.back();
+            blockStack.pop_back();
+            const FlatNode &statement = current.ast->nodes[pending];
+            if (statement.kind == NODE_ASSIGNMENT)
+            {
+                Interpreter::writeVariable(statement.value, statement.local, value, symbolTable);
+                return false;
+            }
+            if (statement.kind != NODE_RETURN)
+            {
+                return false;
+            }
+        }
+    }
+
+    static uint32_t loopBody(const FlatAst &ast, const FlatNode &loop)
+    {
+        if (loop.kind == NODE_WHILE)
+        {
+            return loop.second;
+        }
+        return ast.ranges[loop.value].body;
+    }
+
+    // true when the loop runs its body for the first time
+    bool loopStart(const FlatAst &ast, const FlatNode &loop)
+    {
+        if (loop.kind == NODE_WHILE)
+        {
+            return Interpreter::evaluate(ast, loop.first, symbolTable) != 0;
+        }
+        const FlatRange &range = ast.ranges[loop.value];
+        int start = Interpreter::evaluate(ast, range.start, symbolTable);
+        int stop = Interpreter::evaluate(ast, range.stop, symbolTable);
+        int step = range.step != NO_NODE ? Interpreter::evaluate(ast, range.step, symbolTable) : 1;
+        return Interpreter::startRange(range.slots, start, stop, step, symbolTable);
+    }
+
+    // true when the loop runs its body once more
+    bool loopAgain(const FlatAst &ast, uint32_t index)
+    {
+        const FlatNode &loop = ast.nodes[index];
+        if (loop.kind == NODE_WHILE)
+        {
+            return Interpreter::evaluate(ast, loop.first, symbolTable) != 0;
+        }
+        return Interpreter::nextRange(ast.ranges[loop.value].slots, symbolTable);
+    }
+    // make room for count more values above sp, the stack moves when it grows
+    int *reserveStack(int *sp, int count)
+    {
+        size_t used = sp - vmStack.data();
+        if (used + count > vmStack.size())
+        {
+            vmStack.resize(max(vmStack.size() * 2, used + count));
+            sp = vmStack.data() + used;
+        }
+        return sp;
+    }
+
+    // stackBase is where the values of the chunk start in vmStack
+    int executeChunk(Chunk *chunk, size_t stackBase)
+    {
+        if (profile)
+        {
+            return threadedDispatch ? runChunk<true, true>(chunk, stackBase) : runChunk<false, true>(chunk, stackBase);
+        }
+        return threadedDispatch ? runChunk<true, false>(chunk, stackBase) : runChunk<false, false>(chunk, stackBase);
+    }
+
+    // ------------------------------------------------------------------ JIT
+
+    static const JitHelpers &jitHelpers()
+    {
+        static const JitHelpers helpers{&jitCall, &jitReadGlobal};
+        return helpers;
+    }
+
+    // called by native code for every call it makes, the arguments were pushed in order
+    static int jitCall(void *executor, func_call *call, const int64_t *stackArguments)
+    {
+        return static_cast<Executor *>(executor)->callFromNative(call, stackArguments);
+    }
+
+    static int jitReadGlobal(void *executor, int slot)
+    {
+        return static_cast<Executor *>(executor)->symbolTable.getGlobal(slot);
+    }
+
+    // the native code to run the body with, null to interpret it
+    // counts the call and compiles the body once it reaches the threshold
+    // near the end of the C++ stack the calls go back to the VM, which does not recurse
+    NativeCode *nativeCode(FunctionBody &body)
+    {
+        if (jitSuspended || !stackHasRoom())
+        {
+            return nullptr;
+        }
+        if (body.native != nullptr || !body.jitSupported)
+        {
+            return body.native;
+        }
+        if (++body.calls < (jitMode == JIT_ALWAYS ? 1 : JIT_THRESHOLD))
+        {
+            return nullptr;
+        }
+        body.native = JitCompiler::compile(body.compiled, body.arity, body.frameSize, jitHelpers());
+        if (body.native == nullptr)
+        {
+            body.jitSupported = false;
+            return nullptr;
+        }
+        jitCompiles++;
+        return body.native;
+    }
+
+    // the frame only counts the depth, the native code keeps its locals itself
+    int runNative(func_call *call, FunctionBody &body, const int *arguments, size_t count)
+    {
+        if (jitCheck && !checkActive)
+        {
+            return runChecked(call, body, arguments, count);
+        }
+        nativeCalls++;
+        size_t callerBase = symbolTable.pushFrame(0, nullptr, 0);
+        int value = body.native->entry(this, arguments);
+        symbolTable.popFrame(callerBase);
+        return value;
+    }
+
+    // run the call natively, then in the VM with the JIT suspended, and stop when the values differ
+    // a body with side effects that ran during the native run would repeat them, so the VM run is skipped then
+    int runChecked(func_call *call, FunctionBody &body, const int *arguments, size_t count)
+    {
+        vector<int> saved(arguments, arguments + count);
+        checkActive = true;
+        impureSeen = false;
+        int value = runNative(call, body, saved.data(), count);
+        if (impureSeen)
+        {
+            jitUnchecked++;
+        }
+        else
+        {
+            jitSuspended = true;
+            int expected = interpret(body, saved.data(), count);
+            jitSuspended = false;
+            if (value != expected)
+            {
+                cerr << "Error: JIT check failed for " << call->get_func_name() << "(";
+                for (size_t i = 0; i < count; i++)
+                {
+                    cerr << (i > 0 ? ", " : "") << saved[i];
+                }
+                cerr << "): native code returned " << value << ", the VM returned " << expected << endl;
+                exit(1);
+            }
+            jitChecks++;
+        }
+        checkActive = false;
+        return value;
+    }
+
+    // run the body in a VM loop of its own, its OP_RETURN hands the value back here
+    int interpret(FunctionBody &body, const int *arguments, size_t count)
+    {
+        if (checkActive && !body.jitSupported)
+        {
+            impureSeen = true;
+        }
+        callStack.push_back(CallRecord{nullptr, 0, symbolTable.pushFrame(body.frameSize, arguments, count)});
+        return executeChunk(body.bytecode, nativeTop);
+    }
+
+    int callFromNative(func_call *call, const int64_t *stackArguments)
+    {
+        size_t count = call->get_arguments().size();
+        int arguments[JIT_MAX_ARGUMENTS];
+        for (size_t i = 0; i < count; i++)
+        {
+            arguments[i] = (int)stackArguments[count - 1 - i];
+        }
+        FunctionBody &body = callee(call, count);
+        if (nativeCode(body) != nullptr)
+        {
+            return runNative(call, body, arguments, count);
+        }
+        return interpret(body, arguments, count);
+    }
+
+// VM_NEXT fetches the next instruction and jumps straight to its handler when the compiler supports
+// labels as values (computed goto), otherwise it goes back to the switch
+// every handler ends in its own indirect jump, which the branch predictor can tell apart
+#if HAVE_COMPUTED_GOTO
+#define VM_CASE(op) \
+    case op:        \
+    label_##op:
+#define VM_JUMP()                      \
+    if constexpr (Threaded)            \
+        goto *labels[instruction->op]; \
+    else                               \
+        goto dispatch
+#else
+#define VM_CASE(op) case op:
+#define VM_JUMP() goto dispatch
+#endif
+#define VM_FETCH()                                             \
+    instruction = &code[pc++];                                 \
+    if constexpr (Profile)                                     \
+    {                                                          \
+        dispatchCounts[instruction->op]++;                     \
+        pairCounts[previousOp * OP_COUNT + instruction->op]++; \
+        previousOp = instruction->op;                          \
+    }
+#define VM_NEXT()   \
+    do              \
+    {               \
+        VM_FETCH(); \
+        VM_JUMP();  \
+    } while (0)
+
+    // calls do not recurse on the C++ stack: OP_CALL saves where the caller was in callStack
+    // the arguments are taken off the caller's values and the callee's values start in their place
+    // Profile counts every instruction and every pair of consecutive instructions for --stats
+    // the run ends at OP_HALT, or returns the value when it leaves a call made by native code
+    template <bool Threaded, bool Profile>
+    int runChunk(Chunk *chunk, size_t stackBase)
+    {
+#if HAVE_COMPUTED_GOTO
+        // in OpCode order
+        static void *const labels[] = {
+            &&label_OP_CONST, &&label_OP_LOAD_GLOBAL, &&label_OP_LOAD_LOCAL, &&label_OP_STORE_GLOBAL,
+            &&label_OP_STORE_LOCAL, &&label_OP_DUP, &&label_OP_POP, &&label_OP_ADD, &&label_OP_SUB, &&label_OP_MUL,
+            &&label_OP_DIV, &&label_OP_EQ, &&label_OP_LT, &&label_OP_LE, &&label_OP_GT, &&label_OP_GE,
+            &&label_OP_JUMP, &&label_OP_JUMP_IF_FALSE, &&label_OP_PRINT_STRING, &&label_OP_PRINT_VALUE,
+            &&label_OP_PRINT_SPACE, &&label_OP_PRINT_NEWLINE, &&label_OP_FLUSH, &&label_OP_DEF, &&label_OP_CALL,
+            &&label_OP_RETURN, &&label_OP_FOR_START, &&label_OP_FOR_NEXT, &&label_OP_ADD_CONST_LOCAL,
+            &&label_OP_ADD_CONST_GLOBAL, &&label_OP_ADD_LOCALS, &&label_OP_ADD_GLOBALS, &&label_OP_LOCAL_EQ_JUMP,
+            &&label_OP_LOCAL_LT_JUMP, &&label_OP_LOCAL_LE_JUMP, &&label_OP_LOCAL_GT_JUMP, &&label_OP_LOCAL_GE_JUMP,
+            &&label_OP_GLOBAL_EQ_JUMP, &&label_OP_GLOBAL_LT_JUMP, &&label_OP_GLOBAL_LE_JUMP,
+            &&label_OP_GLOBAL_GT_JUMP, &&label_OP_GLOBAL_GE_JUMP, &&label_OP_HALT};
+        static_assert(sizeof(labels) / sizeof(labels[0]) == OP_COUNT, "one label per opcode");
+#endif
+        const Instruction *code = chunk->code.data();
+        int *sp = reserveStack(vmStack.data() + stackBase, chunk->maxStack);
+        size_t pc = 0;
+        const Instruction *instruction;
+        int previousOp = OP_HALT;
+        // the first instruction always goes through the switch, the handlers pick how to reach the next one
+        VM_FETCH();
+        goto dispatch;
+    dispatch:
+        switch (instruction->op)
+        {
+            VM_CASE(OP_CONST)
+            *sp++ = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_LOAD_GLOBAL)
+            *sp++ = symbolTable.getGlobal(instruction->operand);
+            VM_NEXT();
+            VM_CASE(OP_LOAD_LOCAL)
+            *sp++ = symbolTable.getLocal(instruction->operand);
+            VM_NEXT();
+            VM_CASE(OP_STORE_GLOBAL)
+            symbolTable.setGlobal(instruction->operand, *--sp);
+            VM_NEXT();
+            VM_CASE(OP_STORE_LOCAL)
+            symbolTable.setLocal(instruction->operand, *--sp);
+            VM_NEXT();
+            VM_CASE(OP_DUP)
+            sp[0] = sp[-1];
+            sp++;
+            VM_NEXT();
+            VM_CASE(OP_POP)
+            sp--;
+            VM_NEXT();
+            VM_CASE(OP_ADD)
+            sp--;
+            sp[-1] = wrappingAdd(sp[-1], sp[0]);
+            VM_NEXT();
+            VM_CASE(OP_SUB)
+            sp--;
+            sp[-1] = wrappingSub(sp[-1], sp[0]);
+            VM_NEXT();
+            VM_CASE(OP_MUL)
+            sp--;
+            sp[-1] = wrappingMul(sp[-1], sp[0]);
+            VM_NEXT();
+            VM_CASE(OP_DIV)
+            sp--;
+            if (sp[0] == 0)
+            {
+                cerr << "Error: Division by zero" << endl;
+                exit(1);
+            }
+            if (sp[0] == -1 && sp[-1] == INT_MIN)
+            {
+                cerr << "Error: Integer overflow in division" << endl;
+                exit(1);
+            }
+            sp[-1] = sp[-1] / sp[0];
+            VM_NEXT();
+            VM_CASE(OP_EQ)
+            sp--;
+            sp[-1] = sp[-1] == sp[0];
+            VM_NEXT();
+            VM_CASE(OP_LT)
+            sp--;
+            sp[-1] = sp[-1] < sp[0];
+            VM_NEXT();
+            VM_CASE(OP_LE)
+            sp--;
+            sp[-1] = sp[-1] <= sp[0];
+            VM_NEXT();
+            VM_CASE(OP_GT)
+            sp--;
+            sp[-1] = sp[-1] > sp[0];
+            VM_NEXT();
+            VM_CASE(OP_GE)
+            sp--;
+            sp[-1] = sp[-1] >= sp[0];
+            VM_NEXT();
+            VM_CASE(OP_JUMP)
+            pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_JUMP_IF_FALSE)
+            if (*--sp == 0)
+            {
+                pc = instruction->operand;
+            }
+            VM_NEXT();
+            VM_CASE(OP_PRINT_STRING)
+            output.writeString(chunk->strings[instruction->operand]);
+            VM_NEXT();
+            VM_CASE(OP_PRINT_VALUE)
+            output.writeInt(*--sp);
+            VM_NEXT();
+            VM_CASE(OP_PRINT_SPACE)
+            output.writeChar(' ');
+            VM_NEXT();
+            VM_CASE(OP_PRINT_NEWLINE)
+            output.endLine();
+            VM_NEXT();
+            VM_CASE(OP_FLUSH)
+            output.flush();
+            VM_NEXT();
+            VM_CASE(OP_DEF)
+            defineFunction(chunk->functions[instruction->operand]);
+            VM_NEXT();
+            VM_CASE(OP_CALL)
+            {
+                func_call *call = chunk->calls[instruction->operand];
+                size_t count = call->get_arguments().size();
+                sp -= count;
+                FunctionBody &body = callee(call, count);
+                if (jitMode != JIT_OFF)
+                {
+                    if (nativeCode(body) != nullptr)
+                    {
+                        // native code may start VM runs of its own, above this one's values
+                        size_t used = sp - vmStack.data();
+                        size_t savedTop = nativeTop;
+                        nativeTop = used;
+                        int value = runNative(call, body, sp, count);
+                        nativeTop = savedTop;
+                        sp = vmStack.data() + used;
+                        *sp++ = value;
+                        VM_NEXT();
+                    }
+                    if (checkActive && !body.jitSupported)
+                    {
+                        impureSeen = true;
+                    }
+                }
+                callStack.push_back(CallRecord{chunk, pc, symbolTable.pushFrame(body.frameSize, sp, count)});
+                chunk = body.bytecode;
+                code = chunk->code.data();
+                sp = reserveStack(sp, chunk->maxStack);
+                pc = 0;
+            }
+            VM_NEXT();
+            VM_CASE(OP_FOR_START)
+            {
+                sp -= 3;
+                const RangeLoop &range = chunk->ranges[instruction->operand];
+                if (!Interpreter::startRange(range.slots, sp[0], sp[1], sp[2], symbolTable))
+                {
+                    pc = range.exit;
+                }
+            }
+            VM_NEXT();
+            VM_CASE(OP_FOR_NEXT)
+            {
+                const RangeLoop &range = chunk->ranges[instruction->operand];
+                if (Interpreter::nextRange(range.slots, symbolTable))
+                {
+                    pc = range.body;
+                }
+            }
+            VM_NEXT();
+            VM_CASE(OP_RETURN)
+            {
+                // the statements of the callee left nothing else on the stack, the value takes the arguments' place
+                int value = *--sp;
+                CallRecord caller = callStack.back();
+                callStack.pop_back();
+                symbolTable.popFrame(caller.callerBase);
+                if (caller.chunk == nullptr)
+                {
+                    return value;
+                }
+                chunk = caller.chunk;
+                code = chunk->code.data();
+                pc = caller.pc;
+                *sp++ = value;
+            }
+            VM_NEXT();
+            VM_CASE(OP_ADD_CONST_LOCAL)
+            symbolTable.setLocal(instruction->operand, wrappingAdd(symbolTable.getLocal(instruction->operand), instruction->value));
+            VM_NEXT();
+            VM_CASE(OP_ADD_CONST_GLOBAL)
+            symbolTable.setGlobal(instruction->operand, wrappingAdd(symbolTable.getGlobal(instruction->operand), instruction->value));
+            VM_NEXT();
+            VM_CASE(OP_ADD_LOCALS)
+            *sp++ = wrappingAdd(symbolTable.getLocal(instruction->operand), symbolTable.getLocal(instruction->value));
+            VM_NEXT();
+            VM_CASE(OP_ADD_GLOBALS)
+            {
+                int left = symbolTable.getGlobal(instruction->operand);
+                *sp++ = wrappingAdd(left, symbolTable.getGlobal(instruction->value));
+            }
+            VM_NEXT();
+            VM_CASE(OP_LOCAL_EQ_JUMP)
+            if (!(symbolTable.getLocal(instruction->value2) == instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_LOCAL_LT_JUMP)
+            if (!(symbolTable.getLocal(instruction->value2) < instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_LOCAL_LE_JUMP)
+            if (!(symbolTable.getLocal(instruction->value2) <= instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_LOCAL_GT_JUMP)
+            if (!(symbolTable.getLocal(instruction->value2) > instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_LOCAL_GE_JUMP)
+            if (!(symbolTable.getLocal(instruction->value2) >= instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_GLOBAL_EQ_JUMP)
+            if (!(symbolTable.getGlobal(instruction->value2) == instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_GLOBAL_LT_JUMP)
+            if (!(symbolTable.getGlobal(instruction->value2) < instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_GLOBAL_LE_JUMP)
+            if (!(symbolTable.getGlobal(instruction->value2) <= instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_GLOBAL_GT_JUMP)
+            if (!(symbolTable.getGlobal(instruction->value2) > instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_GLOBAL_GE_JUMP)
+            if (!(symbolTable.getGlobal(instruction->value2) >= instruction->value))
+                pc = instruction->operand;
+            VM_NEXT();
+            VM_CASE(OP_HALT)
+            return 0;
+        }
+        return 0; // every handler jumps to the next one, this is not reached
+    }
+
+#undef VM_CASE
+#undef VM_JUMP
+#undef VM_FETCH
+#undef VM_NEXT
+
+    void freeRetired()
+    {
+        for (FunctionBody *body : retiredBodies)
+        {
+            delete body;
+        }
+        retiredBodies.clear();
+    }
+
+    // a def that rebinds the name replaces the body, the old one is freed once no function is running
+    // since a def inside a function may rebind the function itself, whose statements are still to run
+    // the call site caches that point to it are stale from the version bump on
+    void defineFunction(int func_name, string_view source, vector<int> parameters)
+    {
+        defVersion++;
+        FunctionBody *&slot = funcBlockMap[func_name];
+        if (slot != nullptr)
+        {
+            retiredBodies.push_back(slot);
+        }
+        if (symbolTable.callDepth() == 0)
+        {
+            freeRetired();
+        }
+        slot = new FunctionBody();
+        FunctionBody &body = *slot;
+        body.source.assign(source.data(), source.size());
+        body.parameters = move(parameters);
+        body.arity = body.parameters.size();
+    }
+
+    void defineFunction(FuncDefNode *funcDef) override
+    {
+        vector<int> parameters;
+        for (const IdentifierNode *param : funcDef->getDeclaration()->get_parameters())
+        {
+            parameters.push_back(param->id);
+        }
+        defineFunction(funcDef->getDeclaration()->func_name->id, funcDef->getBody(), move(parameters));
+    }
+
+    void defineFunction(const FlatAst &ast, const FlatNode &funcDef)
+    {
+        vector<int> parameters(ast.listBegin(funcDef.first), ast.listEnd(funcDef.first));
+        defineFunction(funcDef.value, ast.getString(funcDef.second), move(parameters));
+    }
+
+    // check the number of arguments, compile the body on the first call and reuse it afterwards
+    FunctionBody &getFunctionBody(int func_name, size_t argumentCount)
+    {
+        auto it = funcBlockMap.find(func_name);
+        if (it == funcBlockMap.end())
+        {
+            cerr << "Error: Function " << interner.name(func_name) << " not found." << endl;
+            exit(1);
+        }
+        FunctionBody &body = *it->second;
+        if (argumentCount != body.arity)
+        {
+            cerr << "Error: " << interner.name(func_name) << "() takes " << body.arity << " arguments but "
+                 << argumentCount << " were given." << endl;
+            exit(1);
+        }
+        if (body.compiled == nullptr)
+        {
+            body.compiled = FrontEnd::compileFunction(body.source, func_name, body.arena);
+            body.frameSize = Resolver::resolveFunction(body.compiled, body.parameters, symbolTable);
+            body.compiled = Optimizer::optimize(body.compiled, body.arena, "def " + interner.name(func_name));
+            bodyCompiles++;
+        }
+        if (engine == ENGINE_VM && body.bytecode == nullptr)
+        {
+            body.bytecode = BytecodeCompiler::compile(body.compiled, true);
+            body.jitSupported = jitMode != JIT_OFF && HAVE_JIT && JitCompiler::supports(body.compiled);
+        }
+        else if (engine == ENGINE_AST && body.flat.empty())
+        {
+            body.flat = buildFlat(body.compiled);
+        }
+        else if (engine == ENGINE_CLOSURE && body.closures == nullptr)
+        {
+            body.closures = body.arena.make<ClosureBlock>(ClosureCompiler::compile(body.compiled, body.arena));
+        }
+        return body;
+    }
+
+    // the function a call site runs, a call that hits its inline cache costs one compare
+    // the argument count of a call site never changes, so a cached function has passed the arity check
+    FunctionBody &callee(func_call *call, size_t argumentCount)
+    {
+        if (call->cacheVersion == defVersion)
+        {
+            callCacheHits++;
+            return *call->cachedBody;
+        }
+        callCacheMisses++;
+        FunctionBody &body = getFunctionBody(call->get_func_id(), argumentCount);
+        call->cachedBody = &body;
+        call->cacheVersion = defVersion;
+        return body;
+    }
+
+    // the same for a call site of a flat tree, whose cache is kept next to the tree
+    FunctionBody &callee(const FlatAst &ast, const FlatNode &call, size_t argumentCount)
+    {
+        FlatAst::CallCache &cache = ast.callCaches[call.second];
+        if (cache.version == defVersion)
+        {
+            callCacheHits++;
+            return *cache.body;
+        }
+        callCacheMisses++;
+        FunctionBody &body = getFunctionBody(call.value, argumentCount);
+        cache.body = &body;
+        cache.version = defVersion;
+        return body;
+    }
+};
+
+uint32_t Executor::defVersion = 0;
+bool Executor::threadedDispatch = HAVE_COMPUTED_GOTO;
+JitMode Executor::jitMode = JIT_OFF;
+bool Executor::jitCheck = false;
+bool Executor::reloadTrees = false;
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  C++ EMITTER
+//////////////////////////////////////////////////////////////////////////////////
+// --emit-cpp writes the program as one C++ translation unit that needs nothing but the standard library
+// every def becomes a C++ function whose locals are ints, globals carry a flag for the error of reading
+// them before they are set, and a def assigns the function to its name like the interpreter does
+// print goes through a buffer that is written the way the interpreter writes it, so the output is the same
+// bytes, errors included; what C++ leaves unsequenced is sequenced through temporaries where it matters
+
+// the runtime every emitted program starts with
+static const char *const cppPrelude = R"PRELUDE(#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// print() writes into one buffer, at the end of every line on a terminal and otherwise when it fills,
+// at flush() and when the program exits
+class Output
+{
+private:
+    char buffer[64 * 1024];
+    size_t used = 0;
+    bool lineBuffered = isatty(STDOUT_FILENO);
+
+    void reserve(size_t length)
+    {
+        if (length > sizeof(buffer) - used)
+        {
+            flush();
+        }
+    }
+
+public:
+    ~Output()
+    {
+        flush();
+    }
+
+    void flush()
+    {
+        size_t written = 0;
+        while (written < used)
+        {
+            ssize_t count = write(STDOUT_FILENO, buffer + written, used - written);
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            written += count;
+        }
+        used = 0;
+    }
+    void string(const char *text, size_t length)
+    {
+        while (length > 0)
+        {
+            reserve(1);
+            size_t part = length < sizeof(buffer) - used ? length : sizeof(buffer) - used;
+            memcpy(buffer + used, text, part);
+            used += part;
+            text += part;
+            length -= part;
+        }
+    }
+    void character(char c)
+    {
+        reserve(1);
+        buffer[used++] = c;
+    }
+    void number(int value)
+    {
+        reserve(16);
+        used = std::to_chars(buffer + used, buffer + sizeof(buffer), value).ptr - buffer;
+    }
+    void endLine()
+    {
+        character('\n');
+        if (lineBuffered)
+        {
+            flush();
+        }
+    }
+};
+
+static Output out;
+
+// the output so far goes first, then the message
+[[noreturn]] static void fail(const char *format, ...)
+{
+    out.flush();
+    va_list arguments;
+    va_start(arguments, format);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+    exit(1);
+}
+
+struct Global
+{
+    int value;
+    bool defined;
+    const char *name;
+};
+
+static inline int load(const Global &global)
+{
+    if (!global.defined)
+    {
+        fail("Error: Variable %s not found in global scope.\n", global.name);
+    }
+    return global.value;
+}
+static inline void store(Global &global, int value)
+{
+    global.value = value;
+    global.defined = true;
+}
+
+// the arithmetic wraps around like the machine does
+static inline int add(int a, int b)
+{
+    return (int)((unsigned)a + (unsigned)b);
+}
+static inline int sub(int a, int b)
+{
+    return (int)((unsigned)a - (unsigned)b);
+}
+static inline int mul(int a, int b)
+{
+    return (int)((unsigned)a * (unsigned)b);
+}
+static inline int divide(int a, int b)
+{
+    if (b == 0)
+    {
+        fail("Error: Division by zero\n");
+    }
+    if (b == -1 && a == INT_MIN)
+    {
+        fail("Error: Integer overflow in division\n");
+    }
+    return a / b;
+}
+// comparisons are 1 or 0
+static inline int equal(int a, int b)
+{
+    return a == b;
+}
+static inline int less(int a, int b)
+{
+    return a < b;
+}
+static inline int lessEqual(int a, int b)
+{
+    return a <= b;
+}
+static inline int greater(int a, int b)
+{
+    return a > b;
+}
+static inline int greaterEqual(int a, int b)
+{
+    return a >= b;
+}
+static inline void checkStep(int step)
+{
+    if (step == 0)
+    {
+        fail("Error: range() step must not be zero\n");
+    }
+}
+
+// the function a name is bound to by its last def, code is null until the first one runs
+struct Function
+{
+    const char *name;
+    int arity;
+    void (*code)();
+};
+
+static int depth = 0;
+
+template <typename... Arguments>
+static int call(const Function &function, Arguments... arguments)
+{
+    if (function.code == nullptr)
+    {
+        fail("Error: Function %s not found.\n", function.name);
+    }
+    if (function.arity != (int)sizeof...(Arguments))
+    {
+        fail("Error: %s() takes %d arguments but %d were given.\n", function.name, function.arity,
+             (int)sizeof...(Arguments));
+    }
+    if (depth == MAX_DEPTH)
+    {
+        fail("Error: Maximum recursion depth of %lld exceeded.\n", MAX_DEPTH);
+    }
+    depth++;
+    int value = reinterpret_cast<int (*)(Arguments...)>(function.code)(arguments...);
+    depth--;
+    return value;
+}
+
+// deep recursion needs more stack than the usual 8 MB, the main thread's stack grows up to the limit
+static void raiseStackLimit()
+{
+    struct rlimit limit;
+    rlim_t wanted = (rlim_t)MAX_DEPTH * 512 + 8 * 1024 * 1024;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < wanted)
+    {
+        limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || limit.rlim_max > wanted ? wanted : limit.rlim_max;
+        setrlimit(RLIMIT_STACK, &limit);
+    }
+}
+)PRELUDE";
+
+class CppEmitter
+{
+private:
+    // a def found in the program or in the body of another def, emitted as a C++ function of its own
+    struct Definition
+    {
+        const FuncDefNode *node;
+        string name; // of the C++ function
+    };
+
+    // the program or the function being emitted
+    struct Unit
+    {
+        ostringstream code;
+        int indent;
+        int temporaries;
+        int loops;
+        bool topLevel;
+    };
+
+    static constexpr size_t PART_SIZE = 1000;
+
+    SymbolTable &symbolTable;
+    deque<Arena> arenas;         // the compiled function bodies
+    deque<Definition> pending;   // defs found but not emitted yet
+    vector<string> functions;    // emitted functions
+    vector<string> prototypes;
+    vector<int> boundNames;      // names some def binds or some call uses
+    vector<int> globals;         // names of the globals the program uses
+    // globals an earlier statement of the top level has set, the top level reads them without the check
+    vector<char> assigned;
+    int definitions;
+    Unit *unit;
+
+    CppEmitter(SymbolTable &symbolTable) : symbolTable(symbolTable), definitions(0), unit(nullptr) {}
+
+public:
+    static void emit(const BlockNode *program, SymbolTable &symbolTable, int maxDepth, const string &fileName, ostream &out)
+    {
+        CppEmitter emitter(symbolTable);
+        // the top level is cut into functions of PART_SIZE statements, one huge main is more than g++ can take
+        const ArenaArray<Node *> &statements = program->getStatements();
+        size_t parts = 0;
+        for (size_t first = 0; first < statements.size(); first += PART_SIZE)
+        {
+            Unit part{ostringstream(), 1, 0, 0, true};
+            emitter.unit = &part;
+            for (size_t i = first; i < statements.size() && i < first + PART_SIZE; i++)
+            {
+                emitter.emitStatement(statements[i]);
+                if (statements[i]->kind == NODE_ASSIGNMENT)
+                {
+                    int name = static_cast<AssignmentNode *>(statements[i])->variable->id;
+                    if ((size_t)name >= emitter.assigned.size())
+                    {
+                        emitter.assigned.resize(name + 1, false);
+                    }
+                    emitter.assigned[name] = true;
+                }
+            }
+            emitter.declareTemporaries(part);
+            string name = "static void program" + to_string(++parts) + "()";
+            emitter.prototypes.push_back(name);
+            emitter.functions.push_back(name + "\n{\n" + part.code.str() + "}\n");
+        }
+        // bodies are compiled here instead of on their first call, a def may contain more defs
+        while (!emitter.pending.empty())
+        {
+            Definition definition = emitter.pending.front();
+            emitter.pending.pop_front();
+            emitter.emitFunction(definition);
+        }
+
+        out << "// " << fileName << " compiled to C++ by mypython --emit-cpp" << endl;
+        out << "static const long long MAX_DEPTH = " << maxDepth << ";" << endl << endl;
+        out << cppPrelude << endl;
+        for (int name : emitter.globals)
+        {
+            out << "static Global g_" << interner.name(name) << "{0, false, \"" << interner.name(name) << "\"};" << endl;
+        }
+        for (int name : emitter.boundNames)
+        {
+            out << "static Function fn_" << interner.name(name) << "{\"" << interner.name(name) << "\", 0, nullptr};" << endl;
+        }
+        out << endl;
+        for (const string &prototype : emitter.prototypes)
+        {
+            out << prototype << ";" << endl;
+        }
+        for (const string &function : emitter.functions)
+        {
+            out << endl << function;
+        }
+        out << endl << "int main()" << endl << "{" << endl << "    raiseStackLimit();" << endl;
+        for (size_t part = 1; part <= parts; part++)
+        {
+            out << "    program" << part << "();" << endl;
+        }
+        out << "    return 0;" << endl << "}" << endl;
+    }
+
+private:
+    static void addName(vector<int> &names, int name)
+    {
+        if (find(names.begin(), names.end(), name) == names.end())
+        {
+            names.push_back(name);
+        }
+    }
+
+    ostream &line()
+    {
+        return unit->code << string(unit->indent * 4, ' ');
+    }
+
+    void declareTemporaries(Unit &emitted)
+    {
+        if (emitted.temporaries == 0)
+        {
+            return;
+        }
+        emitted.code.str("    int " + temporaryList(emitted.temporaries) + ";\n" + emitted.code.str());
+    }
+
+    static string temporaryList(int count)
+    {
+        string list;
+        for (int i = 1; i <= count; i++)
+        {
+            list += (i > 1 ? ", t" : "t") + to_string(i);
+        }
+        return list;
+    }
+
+    // compile the body like the executor does on the first call, then write it as a C++ function
+    void emitFunction(const Definition &definition)
+    {
+        const func_init *declaration = definition.node->getDeclaration();
+        int funcId = declaration->func_name->id;
+        vector<int> parameters;
+        for (const IdentifierNode *param : declaration->get_parameters())
+        {
+            parameters.push_back(param->id);
+        }
+        arenas.emplace_back();
+        Arena &arena = arenas.back();
+        BlockNode *body = FrontEnd::compileFunction(definition.node->getBody(), funcId, arena);
+        Resolver::resolveFunction(body, parameters, symbolTable);
+        body = Optimizer::optimize(body, arena, "def " + interner.name(funcId));
+
+        string signature = "static int " + definition.name + "(";
+        for (size_t i = 0; i < parameters.size(); i++)
+        {
+            signature += (i > 0 ? ", int l_" : "int l_") + interner.name(parameters[i]);
+        }
+        signature += ")";
+        prototypes.push_back(signature);
+
+        Unit function{ostringstream(), 1, 0, 0, false};
+        unit = &function;
+        // every name the body assigns is a local for the whole body and starts at 0
+        vector<int> locals;
+        collectLocals(body, locals);
+        vector<int> read;
+        collectReads(body, read);
+        for (int local : locals)
+        {
+            if (find(parameters.begin(), parameters.end(), local) == parameters.end())
+            {
+                bool unused = find(read.begin(), read.end(), local) == read.end();
+                line() << (unused ? "[[maybe_unused]] int l_" : "int l_") << interner.name(local) << " = 0;" << endl;
+            }
+        }
+        emitBlock(body);
+        line() << "return 0;" << endl;
+        declareTemporaries(function);
+        functions.push_back(signature + "\n{\n" + function.code.str() + "}\n");
+    }
+
+    static void collectLocals(const Node *node, vector<int> &locals)
+    {
+        switch (node->kind)
+        {
+        case NODE_IDENTIFIER:
+            if (static_cast<const IdentifierNode *>(node)->local)
+            {
+                addName(locals, static_cast<const IdentifierNode *>(node)->id);
+            }
+            break;
+        case NODE_ASSIGNMENT:
+            collectLocals(static_cast<const AssignmentNode *>(node)->variable, locals);
+            collectLocals(static_cast<const AssignmentNode *>(node)->expression, locals);
+            break;
+        case NODE_BLOCK:
+            for (const Node *statement : static_cast<const BlockNode *>(node)->getStatements())
+            {
+                collectLocals(statement, locals);
+            }
+            break;
+        case NODE_IF:
+            collectLocals(static_cast<const IfNode *>(node)->getThenBlock(), locals);
+            if (static_cast<const IfNode *>(node)->getElseBlock() != nullptr)
+            {
+                collectLocals(static_cast<const IfNode *>(node)->getElseBlock(), locals);
+            }
+            break;
+        case NODE_WHILE:
+            collectLocals(static_cast<const WhileNode *>(node)->getBody(), locals);
+            break;
+        case NODE_FOR_RANGE:
+            collectLocals(static_cast<const ForRangeNode *>(node)->getVariable(), locals);
+            collectLocals(static_cast<const ForRangeNode *>(node)->getBody(), locals);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // the locals the body reads, one that is only assigned would make g++ warn
+    static void collectReads(const Node *node, vector<int> &read)
+    {
+        switch (node->kind)
+        {
+        case NODE_IDENTIFIER:
+            if (static_cast<const IdentifierNode *>(node)->local)
+            {
+                addName(read, static_cast<const IdentifierNode *>(node)->id);
+            }
+            break;
+        case NODE_BINOP:
+            collectReads(static_cast<const BinOpNode *>(node)->leftNode, read);
+            collectReads(static_cast<const BinOpNode *>(node)->rightNode, read);
+            break;
+        case NODE_ASSIGNMENT:
+            collectReads(static_cast<const AssignmentNode *>(node)->expression, read);
+            break;
+        case NODE_PRINT:
+            for (const Node *argument : static_cast<const PrintNode *>(node)->getArguments())
+            {
+                collectReads(argument, read);
+            }
+            break;
+        case NODE_FUNC_CALL:
+            for (const Node *argument : static_cast<const func_call *>(node)->get_arguments())
+            {
+                collectReads(argument, read);
+            }
+            break;
+        case NODE_RETURN:
+            if (static_cast<const returnNode *>(node)->getValue() != nullptr)
+            {
+                collectReads(static_cast<const returnNode *>(node)->getValue(), read);
+            }
+            break;
+        case NODE_BLOCK:
+            for (const Node *statement : static_cast<const BlockNode *>(node)->getStatements())
+            {
+                collectReads(statement, read);
+            }
+            break;
+        case NODE_IF:
+            collectReads(static_cast<const IfNode *>(node)->getCondition(), read);
+            collectReads(static_cast<const IfNode *>(node)->getThenBlock(), read);
+            if (static_cast<const IfNode *>(node)->getElseBlock() != nullptr)
+            {
+                collectReads(static_cast<const IfNode *>(node)->getElseBlock(), read);
+            }
+            break;
+        case NODE_WHILE:
+            collectReads(static_cast<const WhileNode *>(node)->getCondition(), read);
+            collectReads(static_cast<const WhileNode *>(node)->getBody(), read);
+            break;
+        case NODE_FOR_RANGE:
+        {
+            const ForRangeNode *forNode = static_cast<const ForRangeNode *>(node);
+            collectReads(forNode->getStart(), read);
+            collectReads(forNode->getStop(), read);
+            if (forNode->getStep() != nullptr)
+            {
+                collectReads(forNode->getStep(), read);
+            }
+            collectReads(forNode->getBody(), read);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void emitBlock(const BlockNode *block)
+    {
+        for (const Node *statement : block->getStatements())
+        {
+            emitStatement(statement);
+        }
+    }
+
+    void emitNested(const BlockNode *block)
+    {
+        line() << "{" << endl;
+        unit->indent++;
+        emitBlock(block);
+        unit->indent--;
+        line() << "}" << endl;
+    }
+
+    void emitStatement(const Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_ASSIGNMENT:
+        {
+            const AssignmentNode *assignmentNode = static_cast<const AssignmentNode *>(node);
+            line() << assignment(assignmentNode->variable, expression(assignmentNode->expression)) << endl;
+            break;
+        }
+        case NODE_PRINT:
+        {
+            // every argument is written before the next one is evaluated, like the interpreter does
+            const ArenaArray<Node *> &arguments = static_cast<const PrintNode *>(node)->getArguments();
+            for (size_t i = 0; i < arguments.size(); i++)
+            {
+                if (i > 0)
+                {
+                    line() << "out.character(' ');" << endl;
+                }
+                if (arguments[i]->kind == NODE_STRING)
+                {
+                    const string &text = static_cast<const StringNode *>(arguments[i])->getValue();
+                    line() << "out.string(" << stringLiteral(text) << ", " << text.size() << ");" << endl;
+                }
+                else
+                {
+                    line() << "out.number(" << expression(arguments[i]) << ");" << endl;
+                }
+            }
+            line() << "out.endLine();" << endl;
+            break;
+        }
+        case NODE_FLUSH:
+            line() << "out.flush();" << endl;
+            break;
+        case NODE_IF:
+        {
+            const IfNode *ifNode = static_cast<const IfNode *>(node);
+            line() << "if (" << expression(ifNode->getCondition()) << ")" << endl;
+            emitNested(ifNode->getThenBlock());
+            if (ifNode->getElseBlock() != nullptr)
+            {
+                line() << "else" << endl;
+                emitNested(ifNode->getElseBlock());
+            }
+            break;
+        }
+        case NODE_WHILE:
+        {
+            const WhileNode *whileNode = static_cast<const WhileNode *>(node);
+            line() << "while (" << expression(whileNode->getCondition()) << ")" << endl;
+            emitNested(whileNode->getBody());
+            break;
+        }
+        case NODE_FOR_RANGE:
+            emitForRange(static_cast<const ForRangeNode *>(node));
+            break;
+        case NODE_BREAK:
+            line() << "break;" << endl;
+            break;
+        case NODE_CONTINUE:
+            line() << "continue;" << endl;
+            break;
+        case NODE_RETURN:
+        {
+            const Node *value = static_cast<const returnNode *>(node)->getValue();
+            line() << "return " << (value != nullptr ? expression(value) : "0") << ";" << endl;
+            break;
+        }
+        case NODE_FUNC_DEF:
+        {
+            const FuncDefNode *funcDef = static_cast<const FuncDefNode *>(node);
+            const func_init *declaration = funcDef->getDeclaration();
+            int name = declaration->func_name->id;
+            Definition definition{funcDef, "f" + to_string(++definitions) + "_" + interner.name(name)};
+            pending.push_back(definition);
+            addName(boundNames, name);
+            line() << "fn_" << interner.name(name) << " = Function{\"" << interner.name(name) << "\", "
+                   << declaration->get_parameters().size() << ", reinterpret_cast<void (*)()>(&" << definition.name
+                   << ")};" << endl;
+            break;
+        }
+        case NODE_FUNC_CALL:
+            line() << expression(node) << ";" << endl;
+            break;
+        default:
+            line() << "(void)" << expression(node) << ";" << endl;
+            break;
+        }
+    }
+
+    // start, stop and step are evaluated once, the counter is a 64 bit C++ local so it cannot wrap around
+    void emitForRange(const ForRangeNode *forNode)
+    {
+        string n = to_string(++unit->loops);
+        line() << "{" << endl;
+        unit->indent++;
+        line() << "int start" << n << " = " << expression(forNode->getStart()) << ";" << endl;
+        line() << "int stop" << n << " = " << expression(forNode->getStop()) << ";" << endl;
+        line() << "int step" << n << " = " << (forNode->getStep() != nullptr ? expression(forNode->getStep()) : "1") << ";"
+               << endl;
+        line() << "checkStep(step" << n << ");" << endl;
+        line() << "for (long long i" << n << " = start" << n << "; step" << n << " > 0 ? i" << n << " < stop" << n << " : i" << n
+               << " > stop" << n << "; i" << n << " += step" << n << ")" << endl;
+        line() << "{" << endl;
+        unit->indent++;
+        line() << assignment(forNode->getVariable(), "(int)i" + n) << endl;
+        emitBlock(forNode->getBody());
+        unit->indent--;
+        line() << "}" << endl;
+        unit->indent--;
+        line() << "}" << endl;
+    }
+
+    string assignment(const IdentifierNode *variable, const string &value)
+    {
+        if (variable->local)
+        {
+            return "l_" + variable->getName() + " = " + value + ";";
+        }
+        addName(globals, variable->id);
+        return "store(g_" + variable->getName() + ", " + value + ");";
+    }
+
+    static string stringLiteral(const string &text)
+    {
+        string literal = "\"";
+        for (unsigned char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                literal += '\\';
+                literal += (char)c;
+            }
+            else if (c < 32 || c >= 127)
+            {
+                // always three octal digits, so a digit after it is not taken into the escape
+                char escape[5];
+                snprintf(escape, sizeof(escape), "\\%03o", c);
+                literal += escape;
+            }
+            else
+            {
+                literal += (char)c;
+            }
+        }
+        return literal + "\"";
+    }
+
+    bool knownGlobal(int name) const
+    {
+        return unit->topLevel && (size_t)name < assigned.size() && assigned[name];
+    }
+
+    // true when evaluating the node can print or stop the program, which C++ must not reorder
+    // a call cannot change the caller's variables, so reading them can move around a call
+    bool hasEffects(const Node *node) const
+    {
+        switch (node->kind)
+        {
+        case NODE_IDENTIFIER:
+            return !static_cast<const IdentifierNode *>(node)->local && !knownGlobal(static_cast<const IdentifierNode *>(node)->id);
+        case NODE_BINOP:
+        {
+            const BinOpNode *binOpNode = static_cast<const BinOpNode *>(node);
+            return binOpNode->op == DIVIDE || hasEffects(binOpNode->leftNode) || hasEffects(binOpNode->rightNode);
+        }
+        case NODE_FUNC_CALL:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    string temporary()
+    {
+        return "t" + to_string(++unit->temporaries);
+    }
+
+    static const char *operatorFunction(TokenType op)
+    {
+        switch (op)
+        {
+        case PLUS:
+            return "add";
+        case MINUS:
+            return "sub";
+        case MULTIPLY:
+            return "mul";
+        case DIVIDE:
+            return "divide";
+        case DOUBLE_EQUAL:
+            return "equal";
+        case LESS_THAN:
+            return "less";
+        case LESS_THAN_OR_EQUAL_TO:
+            return "lessEqual";
+        case GREATER_THAN:
+            return "greater";
+        case GREATER_THAN_OR_EQUAL_TO:
+            return "greaterEqual";
+        default:
+            cerr << "Error: Unknown operator" << endl;
+            exit(1);
+        }
+    }
+
+    string variable(int name, bool local)
+    {
+        if (local)
+        {
+            return "l_" + interner.name(name);
+        }
+        addName(globals, name);
+        if (knownGlobal(name))
+        {
+            return "g_" + interner.name(name) + ".value";
+        }
+        return "load(g_" + interner.name(name) + ")";
+    }
+
+    // a C++ expression of type int
+    string expression(const Node *node)
+    {
+        switch (node->kind)
+        {
+        case NODE_NUMBER:
+        {
+            int value = static_cast<const NumberNode *>(node)->value;
+            if (value == INT_MIN)
+            {
+                return "(-2147483647 - 1)";
+            }
+            return value < 0 ? "(" + to_string(value) + ")" : to_string(value);
+        }
+        case NODE_IDENTIFIER:
+            return variable(static_cast<const IdentifierNode *>(node)->id, static_cast<const IdentifierNode *>(node)->local);
+        case NODE_BINOP:
+        {
+            const BinOpNode *binOpNode = static_cast<const BinOpNode *>(node);
+            string left = expression(binOpNode->leftNode);
+            string right = expression(binOpNode->rightNode);
+            // the left operand goes first when both sides may print or fail
+            string sequence;
+            if (hasEffects(binOpNode->leftNode) && hasEffects(binOpNode->rightNode))
+            {
+                string saved = temporary();
+                sequence = saved + " = " + left + ", ";
+                left = saved;
+            }
+            string value = string(operatorFunction(binOpNode->op)) + "(" + left + ", " + right + ")";
+            return sequence.empty() ? value : "(" + sequence + value + ")";
+        }
+        case NODE_FUNC_CALL:
+        {
+            // the arguments are evaluated in order, one that may print or fail is saved when a later one may too
+            const func_call *call = static_cast<const func_call *>(node);
+            addName(boundNames, call->get_func_id());
+            const ArenaArray<Node *> &arguments = call->get_arguments();
+            size_t lastEffect = arguments.size();
+            for (size_t i = 0; i < arguments.size(); i++)
+            {
+                if (hasEffects(arguments[i]))
+                {
+                    lastEffect = i;
+                }
+            }
+            string sequence;
+            string value = "call(fn_" + call->get_func_name();
+            for (size_t i = 0; i < arguments.size(); i++)
+            {
+                string argument = expression(arguments[i]);
+                if (i < lastEffect && lastEffect != arguments.size() && hasEffects(arguments[i]))
+                {
+                    string saved = temporary();
+                    sequence += saved + " = " + argument + ", ";
+                    argument = saved;
+                }
+                value += ", " + argument;
+            }
+            value += ")";
+            return sequence.empty() ? value : "(" + sequence + value + ")";
+        }
+        default:
+            cerr << "Error: Unexpected node" << endl;
+            exit(1);
+        }
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  SOURCE BUFFER
+//////////////////////////////////////////////////////////////////////////////////
+// the script is mapped once and never copied, tokens, lines and function bodies are views into it
+// a file that cannot be mapped (empty, or not a regular file) is read into memory instead
+class SourceBuffer
+{
+private:
+    const char *data;
+    size_t length;
+    bool mapped;
+    string contents;
+
+public:
+    SourceBuffer(const string &fileName) : data(nullptr), length(0), mapped(false)
+    {
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            cerr << "Unable to open file: " << fileName << endl;
+            exit(1);
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED)
+            {
+                data = static_cast<const char *>(address);
+                length = info.st_size;
+                mapped = true;
+            }
+        }
+        close(fd);
+        if (!mapped)
+        {
+            ifstream file(fileName, ios::binary);
+            stringstream ss;
+            ss << file.rdbuf();
+            contents = ss.str();
+            data = contents.data();
+            length = contents.size();
+        }
+    }
+
+    ~SourceBuffer()
+    {
+        if (mapped)
+        {
+            munmap(const_cast<char *>(data), length);
+        }
+    }
+
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+
+    string_view text() const
+    {
+        return string_view(data, length);
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  BENCHMARKS
+//////////////////////////////////////////////////////////////////////////////////
+// the dynamic_cast chain Interpreter::evaluateNode used before nodes carried their kind, kept for comparison
+static int castChainKind(Node *node)
+{
+    if (dynamic_cast<NumberNode *>(node))
+        return NODE_NUMBER;
+    else if (dynamic_cast<IdentifierNode *>(node))
+        return NODE_IDENTIFIER;
+    else if (dynamic_cast<BinOpNode *>(node))
+        return NODE_BINOP;
+    else if (dynamic_cast<AssignmentNode *>(node))
+        return NODE_ASSIGNMENT;
+    else if (dynamic_cast<PrintNode *>(node))
+        return NODE_PRINT;
+    else if (dynamic_cast<func_init *>(node))
+        return NODE_FUNC_INIT;
+    else if (dynamic_cast<func_call *>(node))
+        return NODE_FUNC_CALL;
+    else if (dynamic_cast<returnNode *>(node))
+        return NODE_RETURN;
+    return -1;
+}
+
+static int switchKind(Node *node)
+{
+    switch (node->kind)
+    {
+    case NODE_NUMBER:
+    case NODE_IDENTIFIER:
+    case NODE_BINOP:
+    case NODE_ASSIGNMENT:
+    case NODE_PRINT:
+    case NODE_FUNC_INIT:
+    case NODE_FUNC_CALL:
+    case NODE_RETURN:
+        return node->kind;
+    default:
+        return -1;
+    }
+}
+
+// time how long it takes to find the kind of a node with each dispatch, in ns per node
+template <typename Dispatch>
+static double timeDispatch(const vector<Node *> &nodes, int rounds, Dispatch dispatch)
+{
+    volatile int sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (Node *node : nodes)
+        {
+            sink = sink + dispatch(node);
+        }
+    }
+    auto finished = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(finished - start).count() / ((double)rounds * nodes.size());
+}
+
+static void benchDispatch()
+{
+    const int copies = 256;
+    const int rounds = 4000;
+    Arena arena;
+    int x = interner.intern("x");
+    int f = interner.intern("f");
+    // one vector per node kind, in the order the cast chain tries them
+    vector<vector<Node *>> samples;
+    for (int i = 0; i < copies; i++)
+    {
+        vector<Node *> nodes = {
+            arena.make<NumberNode>(i),
+            arena.make<IdentifierNode>(x),
+            arena.make<BinOpNode>(PLUS, arena.make<NumberNode>(1), arena.make<NumberNode>(2)),
+            arena.make<AssignmentNode>(arena.make<IdentifierNode>(x), arena.make<NumberNode>(1)),
+            arena.make<PrintNode>(ArenaArray<Node *>()),
+            arena.make<func_init>(arena.make<IdentifierNode>(f), ArenaArray<IdentifierNode *>()),
+            arena.make<func_call>(f, ArenaArray<Node *>()),
+            arena.make<returnNode>(arena.make<IdentifierNode>(x))};
+        for (size_t k = 0; k < nodes.size(); k++)
+        {
+            if (samples.size() <= k)
+            {
+                samples.push_back({});
+            }
+            samples[k].push_back(nodes[k]);
+        }
+    }
+    const char *names[] = {"NumberNode", "IdentifierNode", "BinOpNode", "AssignmentNode",
+                           "PrintNode", "func_init", "func_call", "returnNode"};
+
+    vector<Node *> mixed;
+    cout << "node kind               cast chain (ns)   kind switch (ns)" << endl;
+    for (size_t k = 0; k < samples.size(); k++)
+    {
+        const vector<Node *> &nodes = samples[k];
+        mixed.insert(mixed.end(), nodes.begin(), nodes.end());
+        double castTime = timeDispatch(nodes, rounds, castChainKind);
+        double switchTime = timeDispatch(nodes, rounds, switchKind);
+        cout << left << setw(24) << names[k] << setw(18) << fixed << setprecision(2) << castTime << switchTime << endl;
+    }
+    double castTime = timeDispatch(mixed, rounds / 8, castChainKind);
+    double switchTime = timeDispatch(mixed, rounds / 8, switchKind);
+    cout << left << setw(24) << "all kinds" << setw(18) << castTime << switchTime << endl;
+}
+
+// lex a generated script line by line, the way the front end does, and report the throughput
+static void benchLexer()
+{
+    const int lines = 200000;
+    const int rounds = 10;
+    const char *templates[] = {
+        "counter = counter + 1\n",
+        "total = total * 3 - (value / 2)\n",
+        "if total >= 100:\n",
+        "    result = add(total, counter)\n",
+        "else:\n",
+        "    print(\"total: \", total)\n",
+        "# a comment line that the lexer skips\n",
+        "def add(a, b):\n",
+        "    return a\n",
+        "flag = value == 12345\n"};
+    const int templateCount = sizeof(templates) / sizeof(templates[0]);
+    string source;
+    for (int i = 0; i < lines; i++)
+    {
+        source += templates[i % templateCount];
+    }
+
+    Lexer lexer(source);
+    size_t tokenCount = 0;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        string_view text = source;
+        size_t lineStart = 0;
+        while (lineStart < text.size())
+        {
+            size_t lineEnd = text.find('\n', lineStart);
+            lexer.reset(text.substr(lineStart, lineEnd - lineStart));
+            lexer.tokenize();
+            tokenCount += lexer.getTokens().size();
+            lineStart = lineEnd + 1;
+        }
+    }
+    auto finished = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(finished - start).count();
+    double megabytes = (double)source.size() * rounds / (1024 * 1024);
+    cout << "lexed " << fixed << setprecision(1) << megabytes << " MB (" << tokenCount << " tokens) in "
+         << setprecision(2) << seconds * 1000 << " ms" << endl;
+    cout << "throughput: " << setprecision(1) << megabytes / seconds << " MB/s, "
+         << tokenCount / seconds / 1e6 << " million tokens/s" << endl;
+}
+
+// parse a generated expression heavy script line by line and report the lines parsed per second
+static void benchParser()
+{
+    const int lines = 100000;
+    const int rounds = 10;
+    const char *templates[] = {
+        "total = total * 3 - (value / 2) + counter * counter - 1\n",
+        "flag = a + b * c == d - e / 2\n",
+        "if total >= limit * 2 + offset:\n",
+        "result = add(total, counter * 2) + scale(value - 1, 3)\n",
+        "x = 1 + 2 * 3 - 4 / 5 + 6 * 7 - 8 + 9 * 10\n",
+        "while n < limit - 1:\n",
+        "print(\"total: \", total, value * 2)\n",
+        "return a * b + c * d - e\n"};
+    const int templateCount = sizeof(templates) / sizeof(templates[0]);
+    string source;
+    for (int i = 0; i < lines; i++)
+    {
+        source += templates[i % templateCount];
+    }
+
+    // the lines are lexed once up front so only the parser is timed
+    Lexer lexer(source);
+    vector<TokenBuffer> lineTokens;
+    size_t lineStart = 0;
+    while (lineStart < source.size())
+    {
+        size_t lineEnd = source.find('\n', lineStart);
+        lexer.reset(string_view(source).substr(lineStart, lineEnd - lineStart));
+        lexer.tokenize();
+        lineTokens.push_back(lexer.getTokens());
+        lineStart = lineEnd + 1;
+    }
+
+    Arena arena;
+    size_t parsed = 0;
+    double seconds = 0;
+    for (int round = 0; round < rounds; round++)
+    {
+        arena.release();
+        auto start = chrono::steady_clock::now();
+        for (const TokenBuffer &tokens : lineTokens)
+        {
+            Parser parser(tokens, arena, 0);
+            parsed += parser.parse() != nullptr;
+        }
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    cout << "parsed " << parsed << " lines in " << fixed << setprecision(2) << seconds * 1000 << " ms, "
+         << setprecision(1) << parsed / seconds / 1e6 << " million lines/s" << endl;
+}
+
+// node count and a checksum of the numbers and slots met by a walk, both trees of one script give the same
+struct WalkTotals
+{
+    size_t nodes;
+    long long sum;
+};
+
+static void walkTree(const Node *node, WalkTotals &totals)
+{
+    totals.nodes++;
+    switch (node->kind)
+    {
+    case NODE_NUMBER:
+        totals.sum += static_cast<const NumberNode *>(node)->value;
+        break;
+    case NODE_IDENTIFIER:
+        totals.sum += static_cast<const IdentifierNode *>(node)->slot;
+        break;
+    case NODE_BINOP:
+        walkTree(static_cast<const BinOpNode *>(node)->leftNode, totals);
+        walkTree(static_cast<const BinOpNode *>(node)->rightNode, totals);
+        break;
+    case NODE_ASSIGNMENT:
+        totals.sum += static_cast<const AssignmentNode *>(node)->variable->slot;
+        walkTree(static_cast<const AssignmentNode *>(node)->expression, totals);
+        break;
+    case NODE_PRINT:
+        for (const Node *argument : static_cast<const PrintNode *>(node)->getArguments())
+            walkTree(argument, totals);
+        break;
+    case NODE_FUNC_CALL:
+        for (const Node *argument : static_cast<const func_call *>(node)->get_arguments())
+            walkTree(argument, totals);
+        break;
+    case NODE_RETURN:
+        if (static_cast<const returnNode *>(node)->getValue() != nullptr)
+            walkTree(static_cast<const returnNode *>(node)->getValue(), totals);
+        break;
+    case NODE_BLOCK:
+        for (const Node *statement : static_cast<const BlockNode *>(node)->getStatements())
+            walkTree(statement, totals);
+        break;
+    case NODE_IF:
+    {
+        const IfNode *ifNode = static_cast<const IfNode *>(node);
+        walkTree(ifNode->getCondition(), totals);
+        walkTree(ifNode->getThenBlock(), totals);
+        if (ifNode->getElseBlock() != nullptr)
+            walkTree(ifNode->getElseBlock(), totals);
+        break;
+    }
+    case NODE_WHILE:
+        walkTree(static_cast<const WhileNode *>(node)->getCondition(), totals);
+        walkTree(static_cast<const WhileNode *>(node)->getBody(), totals);
+        break;
+    case NODE_FOR_RANGE:
+    {
+        const ForRangeNode *forNode = static_cast<const ForRangeNode *>(node);
+        walkTree(forNode->getStart(), totals);
+        walkTree(forNode->getStop(), totals);
+        if (forNode->getStep() != nullptr)
+            walkTree(forNode->getStep(), totals);
+        walkTree(forNode->getBody(), totals);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// the same walk following the index links of the flat tree
+static void walkFlatTree(const FlatAst &ast, uint32_t index, WalkTotals &totals)
+{
+    const FlatNode &node = ast.nodes[index];
+    totals.nodes++;
+    switch (node.kind)
+    {
+    case NODE_NUMBER:
+    case NODE_IDENTIFIER:
+        totals.sum += node.value;
+        break;
+    case NODE_BINOP:
+        walkFlatTree(ast, node.first, totals);
+        walkFlatTree(ast, node.second, totals);
+        break;
+    case NODE_ASSIGNMENT:
+        totals.sum += node.value;
+        walkFlatTree(ast, node.first, totals);
+        break;
+    case NODE_PRINT:
+    case NODE_FUNC_CALL:
+    case NODE_BLOCK:
+        for (const uint32_t *child = ast.listBegin(node.first); child != ast.listEnd(node.first); ++child)
+            walkFlatTree(ast, *child, totals);
+        break;
+    case NODE_RETURN:
+        if (node.first != NO_NODE)
+            walkFlatTree(ast, node.first, totals);
+        break;
+    case NODE_IF:
+        walkFlatTree(ast, node.first, totals);
+        walkFlatTree(ast, node.second, totals);
+        if ((uint32_t)node.value != NO_NODE)
+            walkFlatTree(ast, (uint32_t)node.value, totals);
+        break;
+    case NODE_WHILE:
+        walkFlatTree(ast, node.first, totals);
+        walkFlatTree(ast, node.second, totals);
+        break;
+    case NODE_FOR_RANGE:
+    {
+        const FlatRange &range = ast.ranges[node.value];
+        walkFlatTree(ast, range.start, totals);
+        walkFlatTree(ast, range.stop, totals);
+        if (range.step != NO_NODE)
+            walkFlatTree(ast, range.step, totals);
+        walkFlatTree(ast, range.body, totals);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// a pass that does not care about the shape of the tree reads the node array front to back
+static void scanFlatTree(const FlatAst &ast, WalkTotals &totals)
+{
+    for (const FlatNode &node : ast.nodes)
+    {
+        totals.nodes++;
+        switch (node.kind)
+        {
+        case NODE_NUMBER:
+        case NODE_IDENTIFIER:
+        case NODE_ASSIGNMENT:
+            totals.sum += node.value;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// compile a generated script into the pointer tree and into the flat arrays, walk both,
+// save and load the flat one with memcpy and report the time of every step
+static void benchAst()
+{
+    const int lines = 1000000;
+    const int rounds = 5;
+    const char *templates[] = {
+        "total = total * 3 - (value / 2) + counter\n",
+        "flag = a + b * c == d - e / 2\n",
+        "if total >= limit * 2 + offset:\n",
+        "    result = (total + counter * 2) * (value - 1)\n",
+        "else:\n",
+        "    print(\"total: \", total, value * 2)\n",
+        "for i in range(counter, limit, 2):\n",
+        "    counter = counter + i * scale\n",
+        "while counter < limit:\n",
+        "    counter = counter + 1\n"};
+    const int templateCount = sizeof(templates) / sizeof(templates[0]);
+    string source;
+    for (int i = 0; i < lines; i++)
+    {
+        source += templates[i % templateCount];
+    }
+
+    auto start = chrono::steady_clock::now();
+    Arena arena;
+    SymbolTable symbolTable(1000);
+    BlockNode *block = FrontEnd::compile(source, arena);
+    Resolver::resolveProgram(block, symbolTable);
+    block = Optimizer::optimize(block, arena, "program");
+    double treeBuild = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    FlatAst flat = FlatAst::build(block);
+    double flatBuild = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    WalkTotals treeTotals{0, 0};
+    WalkTotals flatTotals{0, 0};
+    WalkTotals scanTotals{0, 0};
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+        walkTree(block, treeTotals);
+    double treeWalk = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / rounds;
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+        walkFlatTree(flat, flat.root, flatTotals);
+    double flatWalk = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / rounds;
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+        scanFlatTree(flat, scanTotals);
+    double flatScan = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / rounds;
+
+    start = chrono::steady_clock::now();
+    vector<char> saved = flat.serialize();
+    double saveTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    start = chrono::steady_clock::now();
+    FlatAst loaded = FlatAst::deserialize(saved);
+    double loadTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    WalkTotals loadedTotals{0, 0};
+    walkFlatTree(loaded, loaded.root, loadedTotals);
+
+    if (treeTotals.nodes != flatTotals.nodes || treeTotals.sum != flatTotals.sum ||
+        scanTotals.nodes != flatTotals.nodes || scanTotals.sum != flatTotals.sum ||
+        loadedTotals.nodes * rounds != flatTotals.nodes || loadedTotals.sum * rounds != flatTotals.sum)
+    {
+        cerr << "Error: the flat tree does not match the pointer tree" << endl;
+        exit(1);
+    }
+
+    size_t nodes = loadedTotals.nodes;
+    cout << lines << " lines, " << nodes << " nodes" << endl;
+    cout << fixed << setprecision(2);
+    cout << "pointer tree: built in " << treeBuild << " ms (lex, parse, resolve, optimize), walked in " << treeWalk
+         << " ms (" << treeWalk * 1e6 / nodes << " ns/node), " << arena.used() << " bytes" << endl;
+    cout << "flat tree:    built in " << flatBuild << " ms from the pointer tree, walked in " << flatWalk
+         << " ms (" << flatWalk * 1e6 / nodes << " ns/node), " << flat.bytes() << " bytes" << endl;
+    cout << "flat scan:    " << flatScan << " ms (" << flatScan * 1e6 / nodes << " ns/node)" << endl;
+    cout << "flat save:    " << saveTime << " ms, load: " << loadTime << " ms, " << saved.size() << " bytes" << endl;
+}
+
+// number of write system calls made by this process so far, -1 where /proc does not report it
+static long writeSyscalls()
+{
+    ifstream io("/proc/self/io");
+    string key;
+    long value;
+    while (io >> key >> value)
+    {
+        if (key == "syscw:")
+        {
+            return value;
+        }
+    }
+    return -1;
+}
+
+// print the same lines the way print used to (cout and endl) and through the writer in both modes
+// everything goes to /dev/null, the report lists the time and the write calls of each
+static void benchOutput()
+{
+    const int lines = 200000;
+    int devNull = open("/dev/null", O_WRONLY);
+    if (devNull < 0)
+    {
+        cerr << "Error: cannot open /dev/null" << endl;
+        exit(1);
+    }
+    cout.flush();
+    int savedStdout = dup(STDOUT_FILENO);
+    dup2(devNull, STDOUT_FILENO);
+
+    const char *names[] = {"cout << endl", "writer, line buffered", "writer, block buffered"};
+    double times[3];
+    long calls[3];
+    for (int mode = 0; mode < 3; mode++)
+    {
+        long before = writeSyscalls();
+        auto start = chrono::steady_clock::now();
+        if (mode == 0)
+        {
+            for (int i = 0; i < lines; i++)
+            {
+                cout << "value:" << " " << i << endl;
+            }
+        }
+        else
+        {
+            OutputWriter writer(STDOUT_FILENO);
+            writer.setLineBuffered(mode == 1);
+            for (int i = 0; i < lines; i++)
+            {
+                writer.writeString("value:");
+                writer.writeChar(' ');
+                writer.writeInt(i);
+                writer.endLine();
+            }
+            writer.flush();
+        }
+        auto finished = chrono::steady_clock::now();
+        times[mode] = chrono::duration<double, milli>(finished - start).count();
+        long after = writeSyscalls();
+        calls[mode] = before < 0 || after < 0 ? -1 : after - before;
+    }
+
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+    close(devNull);
+    cout << lines << " printed lines" << endl;
+    cout << "output                    time (ms)   write calls" << endl;
+    for (int mode = 0; mode < 3; mode++)
+    {
+        cout << left << setw(26) << names[mode] << setw(12) << fixed << setprecision(2) << times[mode];
+        if (calls[mode] < 0)
+            cout << "n/a" << endl;
+        else
+            cout << calls[mode] << endl;
+    }
+}
+
+// run a for-range loop, a while loop and an arithmetic heavy loop on every engine and report the iterations per second
+static void benchLoop()
+{
+    const int iterations = 10000000;
+    const string count = to_string(iterations);
+    const pair<const char *, string> programs[] = {
+        {"for range", "total = 0\nfor i in range(" + count + "):\n    total = total + i\n"},
+        {"while", "total = 0\nn = 0\nwhile n < " + count + ":\n    total = total + n\n    n = n + 1\n"},
+        {"arithmetic", "total = 0\nfor i in range(" + count + "):\n    x = i * 3 + 7\n    y = (x - i) / 2 + x * 2\n"
+                       "    if y > x:\n        total = total + y - x * 2 - i\n"}};
+    const pair<const char *, Engine> engines[] = {{"vm", ENGINE_VM}, {"ast", ENGINE_AST}, {"closure", ENGINE_CLOSURE}};
+    for (const auto &program : programs)
+    {
+        for (const auto &engine : engines)
+        {
+            Arena arena;
+            SymbolTable symbolTable(1000);
+            BlockNode *block = FrontEnd::compile(program.second, arena);
+            Resolver::resolveProgram(block, symbolTable);
+            block = Optimizer::optimize(block, arena, "program");
+            Executor executor(symbolTable, engine.second);
+            auto start = chrono::steady_clock::now();
+            executor.run(block);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << left << setw(11) << program.first << setw(8) << engine.first << right << fixed << setprecision(2)
+                 << seconds * 1000 << " ms, " << setprecision(1) << iterations / seconds / 1e6 << " million iterations/s" << endl;
+        }
+    }
+}
+
+// run a few programs on the VM with switch and computed goto dispatch, with and without superinstructions
+// a profiled run counts the instructions, a plain run is timed
+static void benchVm()
+{
+    const pair<const char *, string> programs[] = {
+        {"calls", "def fib(n):\n    if n < 2:\n        return n\n    return fib(n - 1) + fib(n - 2)\n\nx = fib(27)\n"},
+        {"while", "n = 0\ncount = 0\nwhile n < 5000000:\n    n = n + 1\n    if n > 10:\n        count = count + 1\n"},
+        {"for range", "b = 3\ntotal = 0\nfor i in range(5000000):\n    a = i + b\n    if a > 100:\n        total = total + 1\n"
+                      "    total = total - 1\n"}};
+    cout << "program    dispatch  fused   time (ms)  instructions   million dispatches/s" << endl;
+    for (const auto &program : programs)
+    {
+        for (int fused = 0; fused < 2; fused++)
+        {
+            for (int threaded = 0; threaded <= HAVE_COMPUTED_GOTO; threaded++)
+            {
+                BytecodeCompiler::superinstructions = fused;
+                Executor::threadedDispatch = threaded;
+                size_t dispatches = 0;
+                double seconds = 0;
+                for (int profiled = 1; profiled >= 0; profiled--)
+                {
+                    Arena arena;
+                    SymbolTable symbolTable(1000);
+                    BlockNode *block = FrontEnd::compile(program.second, arena);
+                    Resolver::resolveProgram(block, symbolTable);
+                    block = Optimizer::optimize(block, arena, "program");
+                    Executor executor(symbolTable, ENGINE_VM);
+                    executor.setProfile(profiled);
+                    auto start = chrono::steady_clock::now();
+                    executor.run(block);
+                    if (profiled)
+                        dispatches = executor.dispatched();
+                    else
+                        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                }
+                cout << left << setw(11) << program.first << setw(10) << (threaded ? "goto" : "switch") << setw(8)
+                     << (fused ? "on" : "off") << right << fixed << setprecision(2) << setw(9) << seconds * 1000
+                     << setw(15) << dispatches << setprecision(1) << setw(16) << dispatches / seconds / 1e6 << endl;
+            }
+        }
+    }
+    BytecodeCompiler::superinstructions = true;
+    Executor::threadedDispatch = HAVE_COMPUTED_GOTO;
+}
+
+// the VM with the JIT off and on, the work is done inside functions since the top level is never compiled
+static void benchJit()
+{
+    if (!HAVE_JIT)
+    {
+        cout << "this platform has no JIT" << endl;
+        return;
+    }
+    const pair<const char *, string> programs[] = {
+        {"calls", "def fib(n):\n    if n < 2:\n        return n\n    return fib(n - 1) + fib(n - 2)\n\nx = fib(27)\n"},
+        {"while", "def count(limit):\n    n = 0\n    c = 0\n    while n < limit:\n        n = n + 1\n        if n / 3 * 3 == n:\n"
+                  "            c = c + n * 2\n    return c\n\nx = count(5000000)\n"},
+        {"for range", "def rule(a, b):\n    if a > b:\n        return a - b\n    return b - a\n\ndef total(limit):\n    t = 0\n"
+                      "    for i in range(limit):\n        t = t + rule(i, 1000)\n    return t\n\nx = total(2000000)\n"}};
+    const pair<JitMode, const char *> modes[] = {{JIT_OFF, "off"}, {JIT_ON, "on"}, {JIT_ALWAYS, "always"}};
+    cout << "program    jit     time (ms)  result" << endl;
+    for (const auto &program : programs)
+    {
+        for (const auto &mode : modes)
+        {
+            Executor::jitMode = mode.first;
+            Arena arena;
+            SymbolTable symbolTable(1000);
+            BlockNode *block = FrontEnd::compile(program.second, arena);
+            Resolver::resolveProgram(block, symbolTable);
+            block = Optimizer::optimize(block, arena, "program");
+            Executor executor(symbolTable, ENGINE_VM);
+            auto start = chrono::steady_clock::now();
+            executor.run(block);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << left << setw(11) << program.first << setw(8) << mode.second << right << fixed << setprecision(2)
+                 << setw(9) << seconds * 1000 << "  " << symbolTable.getGlobal(symbolTable.getSlot(interner.intern("x")))
+                 << endl;
+        }
+    }
+    Executor::jitMode = JIT_OFF;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  TESTS
+//////////////////////////////////////////////////////////////////////////////////
+// --test runs every case below on every engine and as emitted C++, each run in a child process since errors exit
+// a case passes when the child prints exactly the expected text to stdout and stderr and exits with the status
+struct TestCase
+{
+    const char *name;
+    const char *source;
+    const char *expected;
+    int status;
+    int maxDepth = 1000;
+    // what the engines that call on the C++ stack print instead with exit status 1, null when all agree
+    const char *stackExpected = nullptr;
+    bool dumpAst = false; // the expected text holds the --dump-ast trees too, the emit-cpp leg is skipped
+};
+
+static const TestCase testCases[] = {
+    {"arithmetic and comparisons", "a = 7\nb = 3\nprint(a + b * 2, (a - b) / 3, a * b - 1)\nprint(a < b, a <= 7, a > b, b >= 3, a == 7)\n",
+     "13 1 20\n0 1 1 1 1\n", 0},
+    {"arithmetic wraps around", "def f(a, b):\n    return a * b - b\n\nx = 2147483647\ny = x + 1\nprint(y, y - 1, x * x)\nprint(f(x, 0 - x))\n",
+     "-2147483648 2147483647 1\n2147483646\n", 0},
+    {"fused additions wrap around", "def f(a, b):\n    c = a + b\n    a = a + 1\n    return a + c\n\nx = 2147483647\nx = x + 1\ny = x + x\n"
+     "print(x, y, f(2147483647, 1))\n", "-2147483648 0 0\n", 0},
+    {"call inside an expression deep in the recursion",
+     "c = 1\ndef f(n):\n    if n == 0:\n        return 0\n    d = f(n - 1) + f(0) + c\n    return d\n\nprint(\"start\")\nprint(f(90000))\n",
+     "start\n90000\n", 0, 100000, "start\nError: Maximum recursion depth exceeded, the C++ stack is exhausted\n"},
+    {"string operand of a simplified operator", "print(\"a\" + 0)\n", "Error: A string can only be an argument of print\n", 1},
+    {"string operand of a multiplication by one", "print(\"a\" * 1)\n", "Error: A string can only be an argument of print\n", 1},
+    {"string assigned to a variable", "print(1)\nx = \"abc\"\n", "Error: A string can only be an argument of print\n", 1},
+    {"string as a call argument", "def f(a):\n    return a\n\nprint(f(\"abc\"))\n", "Error: A string can only be an argument of print\n", 1},
+    {"def rebinds the running function",
+     "def f():\n    def f():\n        return 2\n    x = 5\n    return x\nprint(f())\nprint(f())\n",
+     "5\n2\n", 0},
+    {"division overflow", "def quotient(a, b):\n    return a / b\n\nm = 0 - 2147483647 - 1\nprint(quotient(m, 1))\n"
+     "print(quotient(m, 0 - 1))\n", "-2147483648\nError: Integer overflow in division\n", 1},
+    {"folding leaves errors to run time", "if 0:\n    x = (0 - 2147483647 - 1) / (0 - 1)\n    y = 1 / 0\n"
+     "print(2147483647 + 1)\nprint(65536 * 65536 + 7)\n", "-2147483648\n7\n", 0},
+    {"token after an assignment", "print(1)\nx = 1 2\n", "Error: Unexpected token '2'\n", 1},
+    {"token after a call", "print(1) junk\n", "Error: Unexpected token 'junk'\n", 1},
+    {"token after a condition", "if 1 2:\n    print(1)\n", "Error: Expected ':' after if\n", 1},
+    {"if without a colon", "if 1\n    print(1)\n", "Error: Expected ':' after if\n", 1},
+    {"while without a colon", "while 0\n    print(1)\n", "Error: Expected ':' after while\n", 1},
+    {"def without a colon", "def f()\n    return 1\n", "Error: Expected ':' after def\n", 1},
+    {"for without a colon", "for i in range(3)\n    print(i)\n", "Error: Expected ':' after for\n", 1},
+    {"else without a colon", "if 0:\n    print(1)\nelse\n    print(2)\n", "Error: Expected ':' after else\n", 1},
+    {"loop over locals", "def count(limit, step):\n    total = 0\n    n = 0\n    while n < limit:\n        n = n + step\n"
+     "        total = total + n * n - total / n\n    return total\n\nprint(count(1000, 1))\n", "250500500\n", 0},
+    {"break and continue in nested loops",
+     "total = 0\nfor i in range(10, 0, -3):\n    j = 0\n    while j < 10:\n"
+     "        j = j + 1\n        if j == 2:\n            continue\n"
+     "        if j > i:\n            break\n        total = total + j\n"
+     "    print(i, j, total)\nfor k in range(5):\n    if k == 1:\n"
+     "        continue\n    for m in range(0, -6, -2):\n        if m == -4:\n"
+     "            break\n        print(k, m)\n    if k == 3:\n        break\n"
+     "print(k)\n",
+     "10 10 53\n7 8 79\n4 5 87\n1 3 88\n0 0\n0 -2\n2 0\n2 -2\n3 0\n3 -2\n3\n", 0},
+    {"zero range step",
+     "n = 0\nprint(1)\nfor i in range(1, 5, n):\n    print(i)\n",
+     "1\nError: range() step must not be zero\n", 1},
+    {"call with too few arguments",
+     "def f(a, b):\n    return a + b\nprint(f(1, 2))\nprint(f(1))\n",
+     "3\nError: f() takes 2 arguments but 1 were given.\n", 1},
+    {"call with too many arguments",
+     "def f(a, b):\n    return a + b\nprint(f(1, 2, 3))\n",
+     "Error: f() takes 2 arguments but 3 were given.\n", 1},
+    {"cached call sites after a rebind",
+     "def g():\n    return 1\ndef call():\n    return g()\nfor i in range(2):\n"
+     "    print(call())\ndef g():\n    return 2\nfor i in range(2):\n"
+     "    print(call())\ndef rebind():\n    def g():\n        return 3\n"
+     "    return g() + call()\nprint(rebind(), call())\n",
+     "1\n1\n2\n2\n6 3\n", 0},
+    {"dump of the trees before and after optimizing",
+     "y = 4\nx = 2 * 3 + y * 1\ndef f(a):\n    return a + 0\nprint(f(x))\n",
+     "=== program before optimizing ===\n{\ny = 4\nx = ((2 * 3) + (y * 1))\n"
+     "Function: f(a)\n    return a + 0\n\nprint(f(x))\n}\n"
+     "=== program after optimizing ===\n{\ny = 4\nx = (6 + y)\n"
+     "Function: f(a)\n    return a + 0\n\nprint(f(x))\n}\n"
+     "=== def f before optimizing ===\n{\nreturn (a + 0)\n}\n"
+     "=== def f after optimizing ===\n{\nreturn a\n}\n10\n", 0, 1000, nullptr, true},
+    {"number literal too large", "x = 1\ny = 99999999999 + 1\nprint(y)\n", "Error: Number too large: 99999999999\n", 1},
+};
+
+// run body in a child and collect what it writes, the status is -1 when a signal ended it
+template <typename Body>
+static int runInChild(Body body, string &text)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        cerr << "Error: cannot create a pipe" << endl;
+        exit(1);
+    }
+    cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[1]);
+        cerr.tie(&outputStream);
+        body();
+        exit(0);
+    }
+    close(fds[1]);
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fds[0], buffer, sizeof(buffer))) > 0)
+    {
+        text.append(buffer, count);
+    }
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static BlockNode *compileTest(const TestCase &test, Arena &arena, SymbolTable &symbolTable)
+{
+    BlockNode *block = FrontEnd::compile(test.source, arena);
+    Resolver::resolveProgram(block, symbolTable);
+    return Optimizer::optimize(block, arena, "program");
+}
+
+static int runTestChild(const TestCase &test, Engine engine, bool jit, bool reload, string &text)
+{
+    return runInChild([&]()
+                      {
+        Executor::jitMode = jit ? JIT_ALWAYS : JIT_OFF;
+        Executor::jitCheck = jit;
+        Executor::reloadTrees = reload;
+        Optimizer::dumpTrees = test.dumpAst;
+        Arena arena;
+        SymbolTable symbolTable(test.maxDepth);
+        BlockNode *block = compileTest(test, arena, symbolTable);
+        Executor executor(symbolTable, engine);
+        executor.run(block);
+        output.flush(); },
+                      text);
+}
+
+// the emit-cpp leg writes the program as C++, builds it with $CXX (c++ by default) and runs it
+// an error of the emitter itself is the result, like a compile error of an engine
+// the status is 127 when there is no compiler, the caller then skips the leg
+static int runEmittedTest(const TestCase &test, const string &directory, size_t index, string &text)
+{
+    string source;
+    int status = runInChild([&]()
+                            {
+        Arena arena;
+        SymbolTable symbolTable(test.maxDepth);
+        BlockNode *block = compileTest(test, arena, symbolTable);
+        CppEmitter::emit(block, symbolTable, test.maxDepth, "test.py", cout);
+        cout.flush(); },
+                            source);
+    if (status != 0)
+    {
+        text = source;
+        return status;
+    }
+    string sourceFile = directory + "/test" + to_string(index) + ".cpp";
+    string binary = directory + "/test" + to_string(index);
+    ofstream(sourceFile) << source;
+    const char *compiler = getenv("CXX") != nullptr ? getenv("CXX") : "c++";
+    string messages;
+    status = runInChild([&]()
+                        {
+        execlp(compiler, compiler, "-std=c++17", "-O1", "-w", "-o", binary.c_str(), sourceFile.c_str(), (char *)nullptr);
+        _exit(127); },
+                        messages);
+    if (status == 0)
+    {
+        status = runInChild([&]()
+                            {
+            execl(binary.c_str(), binary.c_str(), (char *)nullptr);
+            _exit(127); },
+                            text);
+    }
+    else if (status == 127)
+    {
+        text = string(compiler) + " not found\n";
+    }
+    else
+    {
+        text = "the emitted C++ does not compile:\n" + messages;
+        status = -1;
+    }
+    unlink(sourceFile.c_str());
+    unlink(binary.c_str());
+    return status;
+}
+
+static int runTests()
+{
+    struct TestEngine
+    {
+        const char *name;
+        Engine engine;
+        bool jit;
+        bool emit;
+        bool reload; // the flat trees go through serialize and deserialize
+    };
+    const TestEngine engines[] = {{"vm", ENGINE_VM, false, false, false}, {"ast", ENGINE_AST, false, false, false},
+                                  {"ast-reload", ENGINE_AST, false, false, true},
+                                  {"closure", ENGINE_CLOSURE, false, false, false}, {"jit", ENGINE_VM, true, false, false},
+                                  {"emit-cpp", ENGINE_VM, false, true, false}};
+    char directoryTemplate[] = "/tmp/mypython-test-XXXXXX";
+    const char *directory = mkdtemp(directoryTemplate);
+    bool haveCompiler = directory != nullptr;
+    int runs = 0;
+    int failures = 0;
+    for (size_t index = 0; index < sizeof(testCases) / sizeof(testCases[0]); index++)
+    {
+        const TestCase &test = testCases[index];
+        for (const TestEngine &engine : engines)
+        {
+            if ((engine.jit && !HAVE_JIT) || (engine.emit && (!haveCompiler || test.dumpAst)))
+            {
+                continue;
+            }
+            const char *expected = test.expected;
+            int expectedStatus = test.status;
+            if (test.stackExpected != nullptr && engine.engine != ENGINE_VM)
+            {
+                expected = test.stackExpected;
+                expectedStatus = 1;
+            }
+            string text;
+            int status = engine.emit ? runEmittedTest(test, directory, index, text)
+                                     : runTestChild(test, engine.engine, engine.jit, engine.reload, text);
+            if (engine.emit && status == 127)
+            {
+                cout << "emit-cpp runs skipped, no C++ compiler: " << text;
+                haveCompiler = false;
+                continue;
+            }
+            runs++;
+            if (status != expectedStatus || text != expected)
+            {
+                failures++;
+                cout << "FAILED: " << test.name << " (" << engine.name << "), exit status " << status << ", output:" << endl
+                     << text;
+            }
+        }
+    }
+    if (directory != nullptr)
+    {
+        rmdir(directory);
+    }
+    cout << runs - failures << " of " << runs << " test runs passed" << endl;
+    return failures == 0 ? 0 : 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//                                  MAIN
+//////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+    // --stats prints the execution counters and timings to stderr when the program ends
+    // --engine selects the bytecode VM (default), the AST walker or the closure compiler
+    // --bench=<name> runs one of the built in benchmarks instead of a script, --test runs the built in tests
+    // --max-depth limits how many calls can be active at once
+    // --dispatch picks how the VM reaches the next instruction, --superinstructions=off keeps the fused ones out
+    // --jit=on compiles hot functions of the VM to x86-64 code, --jit=always on their first call
+    // --jit-check runs every outermost native call in the VM as well and stops when the values differ
+    // --dump-ast prints the tree of the program and of every function body before and after the optimizer
+    // --emit-cpp writes the program as C++ to stdout instead of running it
+    // --output=line writes every printed line at once, --output=block only when the buffer fills or at flush()
+    // the default is line buffering on a terminal and block buffering otherwise
+    bool showStats = false;
+    bool emitCpp = false;
+    Engine engine = ENGINE_VM;
+    int maxDepth = 1000;
+    string fileName;
+    bool badArgs = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--stats")
+        {
+            showStats = true;
+        }
+        else if (arg == "--engine=vm")
+        {
+            engine = ENGINE_VM;
+        }
+        else if (arg == "--engine=ast")
+        {
+            engine = ENGINE_AST;
+        }
+        else if (arg == "--engine=closure")
+        {
+            engine = ENGINE_CLOSURE;
+        }
+        else if (arg == "--dispatch=switch")
+        {
+            Executor::threadedDispatch = false;
+        }
+        else if (arg == "--dispatch=goto" && HAVE_COMPUTED_GOTO)
+        {
+            Executor::threadedDispatch = true;
+        }
+        else if (arg == "--superinstructions=off")
+        {
+            BytecodeCompiler::superinstructions = false;
+        }
+        else if (arg == "--superinstructions=on")
+        {
+            BytecodeCompiler::superinstructions = true;
+        }
+        else if (arg == "--jit=off")
+        {
+            Executor::jitMode = JIT_OFF;
+        }
+        else if (arg == "--jit=on" && HAVE_JIT)
+        {
+            Executor::jitMode = JIT_ON;
+        }
+        else if (arg == "--jit=always" && HAVE_JIT)
+        {
+            Executor::jitMode = JIT_ALWAYS;
+        }
+        else if (arg == "--jit-check")
+        {
+            Executor::jitCheck = true;
+        }
+        else if (arg == "--emit-cpp")
+        {
+            emitCpp = true;
+        }
+        else if (arg == "--dump-ast")
+        {
+            Optimizer::dumpTrees = true;
+        }
+        else if (arg == "--output=line")
+        {
+            output.setLineBuffered(true);
+        }
+        else if (arg == "--output=block")
+        {
+            output.setLineBuffered(false);
+        }
+        else if (arg.compare(0, 12, "--max-depth=") == 0 && atoi(arg.c_str() + 12) > 0)
+        {
+            maxDepth = atoi(arg.c_str() + 12);
+        }
+        else if (arg == "--bench=dispatch")
+        {
+            benchDispatch();
+            return 0;
+        }
+        else if (arg == "--bench=lexer")
+        {
+            benchLexer();
+            return 0;
+        }
+        else if (arg == "--bench=parser")
+        {
+            benchParser();
+            return 0;
+        }
+        else if (arg == "--bench=ast")
+        {
+            benchAst();
+            return 0;
+        }
+        else if (arg == "--bench=output")
+        {
+            benchOutput();
+            return 0;
+        }
+        else if (arg == "--bench=vm")
+        {
+            benchVm();
+            return 0;
+        }
+        else if (arg == "--bench=jit")
+        {
+            benchJit();
+            return 0;
+        }
+        else if (arg == "--bench=loop")
+        {
+            benchLoop();
+            return 0;
+        }
+        else if (arg == "--test")
+        {
+            return runTests();
+        }
+        else if (fileName.empty() && arg[0] != '-')
+        {
+            fileName = arg;
+        }
+        else
+        {
+            badArgs = true;
+        }
+    }
+    if (badArgs || fileName.empty())
+    {
+        cerr << "Usage: " << argv[0] << " [--stats] [--engine=vm|ast|closure] [--dispatch=switch|goto] [--superinstructions=on|off] [--jit=off|on|always] [--jit-check] [--max-depth=N] [--dump-ast] [--emit-cpp] [--output=line|block] <filename>" << endl;
+        cerr << "       " << argv[0] << " --bench=dispatch|lexer|parser|ast|output|loop|vm|jit" << endl;
+        cerr << "       " << argv[0] << " --test" << endl;
+        return 1;
+    }
+
+    // anything written to cerr first flushes what print has buffered
+    cerr.tie(&outputStream);
+
+    auto start = chrono::steady_clock::now();
+    SourceBuffer source(fileName);
+
+    // Compile the whole program once, nothing is lexed or parsed while it runs
+    // every node of the program lives in one arena that is freed when main returns
+    Arena programArena;
+    SymbolTable symbolTable(maxDepth);
+    BlockNode *program = FrontEnd::compile(source.text(), programArena);
+    Resolver::resolveProgram(program, symbolTable);
+    program = Optimizer::optimize(program, programArena, "program");
+    auto compiled = chrono::steady_clock::now();
+
+    if (emitCpp)
+    {
+        CppEmitter::emit(program, symbolTable, maxDepth, fileName, cout);
+        return 0;
+    }
+
+    Executor executor(symbolTable, engine);
+    executor.setProfile(showStats && engine == ENGINE_VM);
+    executor.run(program);
+    auto finished = chrono::steady_clock::now();
+
+    if (showStats)
+    {
+        output.flush();
+        executor.printStats();
+        cerr << "output write calls: " << output.getWriteCalls() << endl;
+        cerr << "program arena: " << programArena.used() << " bytes used, " << programArena.reserved() << " bytes reserved" << endl;
+        cerr << "compile time: " << chrono::duration<double, milli>(compiled - start).count() << " ms" << endl;
+        cerr << "run time: " << chrono::duration<double, milli>(finished - compiled).count() << " ms" << endl;
     }
 
     return 0;